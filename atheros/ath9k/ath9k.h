@@ -18,6 +18,7 @@
 #define ATH9K_H
 
 #include <linux/io.h>
+#include <linux/interrupt.h>
 
 #define ATHEROS_VENDOR_ID	0x168c
 
@@ -243,6 +244,8 @@ struct hal_ops_config {
 	u_int16_t ath_hal_antennaSwitchSwap;
 	int ath_hal_serializeRegMode;
 	int ath_hal_intrMitigation;
+	int ath_hal_calSnapAge;
+	int ath_hal_calAsync;
 	int ath_hal_debug;
 #define SPUR_DISABLE        	0
 #define SPUR_ENABLE_IOCTL   	1
@@ -650,8 +653,13 @@ struct hal_country_entry {
 #define HAL_DBG_SPUR_MITIGATE	0x02000000
 #define HAL_DBG_UNMASKABLE      0xFFFFFFFF
 
+#ifdef CONFIG_ATH9K_REGSHADOW
+#define REG_WRITE(_ah, _reg, _val) ath9k_hw_reg_write(_ah, _reg, _val)
+#define REG_READ(_ah, _reg) ath9k_hw_reg_read(_ah, _reg)
+#else
 #define REG_WRITE(_ah, _reg, _val) iowrite32(_val, _ah->ah_sh + _reg)
 #define REG_READ(_ah, _reg) ioread32(_ah->ah_sh + _reg)
+#endif
 
 #define SM(_v, _f)  (((_v) << _f##_S) & _f)
 #define MS(_v, _f)  (((_v) & _f) >> _f##_S)
@@ -909,6 +917,62 @@ enum {
 #define AH_USE_EEPROM   0x1
 #define AH_IS_HB63      0x2
 
+/* stages of ath9k_hw_reset(), timed separately */
+enum hal_reset_phase {
+	HAL_RESET_PHASE_PREP,		/* wake, NF, fast change try */
+	HAL_RESET_PHASE_CHIP,		/* chip reset, pll */
+	HAL_RESET_PHASE_INI,		/* process_ini, txpower */
+	HAL_RESET_PHASE_SPUR,		/* spur, board values */
+	HAL_RESET_PHASE_CHANNEL,	/* synthesizer */
+	HAL_RESET_PHASE_MAC,		/* queues, interrupts, dma */
+	HAL_RESET_PHASE_BB,		/* baseband activation */
+	HAL_RESET_PHASE_CAL,		/* init cals */
+	HAL_RESET_PHASE_MAX
+};
+
+#define HAL_RESET_SLOW_US	10000	/* resets logged as slow */
+
+struct hal_reset_stats {
+	u_int32_t rt_resets;		/* full resets */
+	u_int32_t rt_fastchan;		/* fast channel changes */
+	u_int32_t rt_fastchan_last;	/* usecs */
+	u_int32_t rt_slow;		/* over HAL_RESET_SLOW_US */
+	u_int32_t rt_txpow_pre;		/* txpower tables built early */
+	u_int64_t rt_overlap;		/* usecs of settle time used */
+	u_int32_t rt_last[HAL_RESET_PHASE_MAX];		/* usecs */
+	u_int32_t rt_max[HAL_RESET_PHASE_MAX];		/* usecs */
+	u_int64_t rt_total[HAL_RESET_PHASE_MAX];	/* usecs */
+};
+
+/* one record per ath9k_hw_reset() call, kept in a ring */
+#define HAL_RESET_TRACE_LEN	32
+
+struct hal_reset_trace {
+	u_int32_t tr_seq;
+	u_int16_t tr_channel;
+	u_int32_t tr_channelFlags;
+	enum hal_bool tr_fastchan;
+	enum hal_status tr_status;
+	u_int32_t tr_total;				/* usecs */
+	u_int32_t tr_phase[HAL_RESET_PHASE_MAX];	/* usecs */
+};
+
+struct hal_cal_stats {
+	u_int32_t cs_cold;		/* channel calibrated from scratch */
+	u_int32_t cs_warm;		/* channel restored from a snapshot */
+	u_int32_t cs_stale;		/* snapshots discarded as too old */
+	u_int32_t cs_restored;		/* periodic cals restored */
+	u_int32_t cs_saved;		/* snapshots taken */
+	u_int32_t cs_steps;		/* ath9k_hw_calibrate() calls */
+	u_int32_t cs_step_last;		/* usecs */
+	u_int32_t cs_step_max;		/* usecs */
+	u_int64_t cs_step_total;	/* usecs */
+	u_int32_t cs_deferred;		/* hw waits left to the caller */
+	u_int32_t cs_timeouts;		/* deferred waits that expired */
+	u_int64_t cs_wait_async;	/* usecs of hw wait not spun on */
+	u_int64_t cs_wait_spun;		/* usecs polled in place */
+};
+
 struct ath_hal {
 	u_int32_t ah_magic;
 	u_int16_t ah_devid;
@@ -944,9 +1008,19 @@ struct ath_hal {
 	enum hal_bool ah_rfkillEnabled;
 	enum hal_bool ah_isPciExpress;
 	u_int16_t ah_txTrigLevel;
+	struct hal_reset_stats ah_resetstats;
+	struct hal_reset_trace ah_resettrace[HAL_RESET_TRACE_LEN];
+	u_int32_t ah_resettrace_seq;
+	struct hal_cal_stats ah_calstats;
 #ifndef ATH_NF_PER_CHAN
 	struct hal_nfcal_hist nfCalHist[NUM_NF_READINGS];
 #endif
+#ifdef CONFIG_ATH9K_SIM
+	struct ath9k_sim *ah_sim;
+#endif
+#ifdef CONFIG_ATH9K_REGSHADOW
+	struct ath9k_regshadow *ah_shadow;
+#endif
 };
 
 #define HDPRINTF(_ah, _m, _fmt, ...) do {				\
@@ -1013,6 +1087,8 @@ enum hal_bool ath9k_regd_init_channels(struct ath_hal *ah,
 u_int ath9k_hw_mhz2ieee(struct ath_hal *ah, u_int freq, u_int flags);
 enum hal_int ath9k_hw_set_interrupts(struct ath_hal *ah,
 				     enum hal_int ints);
+void ath9k_hw_set_rxmitigation(struct ath_hal *ah,
+			       u_int32_t last, u_int32_t first);
 enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 			     struct hal_channel *chan,
 			     enum hal_ht_macmode macmode,
@@ -1031,6 +1107,7 @@ enum hal_bool ath9k_hw_calibrate(struct ath_hal *ah,
 				 u_int8_t rxchainmask,
 				 enum hal_bool longcal,
 				 enum hal_bool *isCalDone);
+enum hal_status ath9k_hw_cal_status(struct ath_hal *ah);
 int16_t ath9k_hw_getchan_noise(struct ath_hal *ah,
 			       struct hal_channel *chan);
 void ath9k_hw_write_associd(struct ath_hal *ah, const u_int8_t *bssid,
@@ -1187,4 +1264,219 @@ enum hal_bool ath9k_get_channel_edges(struct ath_hal *ah,
 enum hal_bool ath9k_hw_get_chip_power_limits(struct ath_hal *ah,
 					     struct hal_channel *chans,
 					     u_int32_t nchans);
+
+/*
+ * Software chip model. When attached it takes over the tx/rx DMA
+ * engine and the interrupt status; descriptors are completed in
+ * software with the configured airtime, loss and block-ack pattern.
+ */
+
+struct hal_sim_config {
+	u_int32_t sim_overhead;		/* per-attempt access + ack, usec */
+	u_int32_t sim_loss;		/* MPDU loss rate, per 1000 */
+	u_int32_t sim_ba_low;		/* block-ack mask, subframes 0-31 */
+	u_int32_t sim_ba_high;		/* block-ack mask, subframes 32-63 */
+	int8_t sim_rssi;		/* ack/rx rssi reported */
+};
+
+struct hal_sim_stats {
+	u_int32_t ss_txppdu;		/* tx units completed */
+	u_int32_t ss_txmpdu;		/* tx MPDUs completed */
+	u_int32_t ss_txlost;		/* tx MPDU attempts lost */
+	u_int32_t ss_txxretry;		/* tx units failed */
+	u_int32_t ss_rxframes;		/* rx frames delivered */
+	u_int32_t ss_rxdrop;		/* rx frames dropped, no descriptor */
+	u_int64_t ss_airtime;		/* virtual air time used, usec */
+};
+
+#define HAL_SIM_RX_AGGR		0x01
+#define HAL_SIM_RX_MOREAGGR	0x02
+
+#ifdef CONFIG_ATH9K_SIM
+#define ath9k_hw_sim_active(_ah)	((_ah)->ah_sim != NULL)
+
+void ath9k_hw_sim_attach(struct ath_hal *ah);
+void ath9k_hw_sim_detach(struct ath_hal *ah);
+void ath9k_hw_sim_setisr(struct ath_hal *ah, irq_handler_t handler,
+			 void *arg);
+void ath9k_hw_sim_addregion(struct ath_hal *ah, void *va,
+			    u_int32_t pa, u_int32_t len);
+void ath9k_hw_sim_delregion(struct ath_hal *ah, void *va);
+void ath9k_hw_sim_reset(struct ath_hal *ah);
+void ath9k_hw_sim_setconfig(struct ath_hal *ah,
+			    const struct hal_sim_config *config);
+void ath9k_hw_sim_getconfig(struct ath_hal *ah, struct hal_sim_config *config);
+void ath9k_hw_sim_getstats(struct ath_hal *ah, struct hal_sim_stats *stats);
+enum hal_bool ath9k_hw_sim_rxinject(struct ath_hal *ah, const void *frame,
+				    u_int len, u_int8_t rate, u_int flags);
+enum hal_bool ath9k_hw_sim_puttxbuf(struct ath_hal *ah, u_int q,
+				    u_int32_t txdp);
+u_int32_t ath9k_hw_sim_gettxbuf(struct ath_hal *ah, u_int q);
+enum hal_bool ath9k_hw_sim_txstart(struct ath_hal *ah, u_int q);
+void ath9k_hw_sim_putrxbuf(struct ath_hal *ah, u_int32_t rxdp);
+void ath9k_hw_sim_rxena(struct ath_hal *ah, enum hal_bool enable);
+enum hal_bool ath9k_hw_sim_intrpend(struct ath_hal *ah);
+enum hal_bool ath9k_hw_sim_getisr(struct ath_hal *ah, enum hal_int *masked);
+enum hal_int ath9k_hw_sim_set_interrupts(struct ath_hal *ah,
+					 enum hal_int ints);
+#else
+#define ath9k_hw_sim_active(_ah)	0
+
+static inline void ath9k_hw_sim_attach(struct ath_hal *ah) {}
+static inline void ath9k_hw_sim_detach(struct ath_hal *ah) {}
+static inline void ath9k_hw_sim_setisr(struct ath_hal *ah,
+				       irq_handler_t handler, void *arg) {}
+static inline void ath9k_hw_sim_addregion(struct ath_hal *ah, void *va,
+					  u_int32_t pa, u_int32_t len) {}
+static inline void ath9k_hw_sim_delregion(struct ath_hal *ah, void *va) {}
+static inline void ath9k_hw_sim_reset(struct ath_hal *ah) {}
+static inline void ath9k_hw_sim_setconfig(struct ath_hal *ah,
+				const struct hal_sim_config *config) {}
+static inline void ath9k_hw_sim_getconfig(struct ath_hal *ah,
+					  struct hal_sim_config *config) {}
+static inline void ath9k_hw_sim_getstats(struct ath_hal *ah,
+					 struct hal_sim_stats *stats) {}
+static inline enum hal_bool ath9k_hw_sim_rxinject(struct ath_hal *ah,
+						  const void *frame,
+						  u_int len, u_int8_t rate,
+						  u_int flags)
+{
+	return AH_FALSE;
+}
+static inline enum hal_bool ath9k_hw_sim_puttxbuf(struct ath_hal *ah,
+						  u_int q, u_int32_t txdp)
+{
+	return AH_FALSE;
+}
+static inline u_int32_t ath9k_hw_sim_gettxbuf(struct ath_hal *ah, u_int q)
+{
+	return 0;
+}
+static inline enum hal_bool ath9k_hw_sim_txstart(struct ath_hal *ah,
+						 u_int q)
+{
+	return AH_FALSE;
+}
+static inline void ath9k_hw_sim_putrxbuf(struct ath_hal *ah,
+					 u_int32_t rxdp) {}
+static inline void ath9k_hw_sim_rxena(struct ath_hal *ah,
+				      enum hal_bool enable) {}
+static inline enum hal_bool ath9k_hw_sim_intrpend(struct ath_hal *ah)
+{
+	return AH_FALSE;
+}
+static inline enum hal_bool ath9k_hw_sim_getisr(struct ath_hal *ah,
+						enum hal_int *masked)
+{
+	return AH_FALSE;
+}
+static inline enum hal_int ath9k_hw_sim_set_interrupts(struct ath_hal *ah,
+						       enum hal_int ints)
+{
+	return 0;
+}
+#endif /* CONFIG_ATH9K_SIM */
+
+/*
+ * Baseband register shadow. When attached, registers only software
+ * changes are read back from memory and identical rewrites dropped;
+ * while buffering, writes are queued and issued in order later.
+ */
+
+struct hal_reg_stats {
+	u_int32_t rs_reads;		/* MMIO reads issued */
+	u_int32_t rs_reads_saved;	/* reads answered by the shadow */
+	u_int32_t rs_writes;		/* MMIO writes issued */
+	u_int32_t rs_writes_saved;	/* rewrites of the same value dropped */
+	u_int32_t rs_buffered;		/* writes queued while buffering */
+	u_int32_t rs_resets;		/* ath9k_hw_reset calls */
+};
+
+/*
+ * Reset profiles. With the shadow attached, the register writes
+ * ath9k_hw_process_ini() resolves for a channel are recorded the first
+ * time the channel is visited and replayed on later visits, skipping
+ * the table walks, EEPROM interpolation and RF bank setup.
+ */
+
+struct hal_prof_stats {
+	u_int32_t ps_hits;		/* resets replayed from a profile */
+	u_int32_t ps_misses;		/* resets that recorded a profile */
+	u_int32_t ps_evicted;		/* profiles replaced */
+	u_int32_t ps_dropped;		/* recordings empty or too long */
+	u_int32_t ps_profiles;		/* profiles held */
+	u_int32_t ps_writes;		/* register writes held */
+};
+
+#ifdef CONFIG_ATH9K_REGSHADOW
+void ath9k_hw_shadow_attach(struct ath_hal *ah);
+void ath9k_hw_shadow_detach(struct ath_hal *ah);
+u_int32_t ath9k_hw_shadow_read(struct ath_hal *ah, u_int32_t reg);
+void ath9k_hw_shadow_write(struct ath_hal *ah, u_int32_t reg, u_int32_t val);
+void ath9k_hw_shadow_buffer(struct ath_hal *ah, enum hal_bool enable);
+void ath9k_hw_shadow_flush(struct ath_hal *ah);
+void ath9k_hw_shadow_invalidate(struct ath_hal *ah);
+void ath9k_hw_shadow_reset(struct ath_hal *ah, enum hal_bool done);
+void ath9k_hw_shadow_getstats(struct ath_hal *ah,
+			      struct hal_reg_stats *total,
+			      struct hal_reg_stats *reset);
+enum hal_bool ath9k_hw_profile_replay(struct ath_hal *ah,
+				      struct hal_channel *chan,
+				      struct hal_channel_internal *ichan,
+				      enum hal_ht_macmode macmode);
+void ath9k_hw_profile_record(struct ath_hal *ah);
+void ath9k_hw_profile_save(struct ath_hal *ah, enum hal_bool ok);
+void ath9k_hw_profile_flush(struct ath_hal *ah);
+void ath9k_hw_profile_getstats(struct ath_hal *ah,
+			       struct hal_prof_stats *stats);
+
+static inline u_int32_t ath9k_hw_reg_read(struct ath_hal *ah, u_int32_t reg)
+{
+	if (unlikely(ah->ah_shadow != NULL))
+		return ath9k_hw_shadow_read(ah, reg);
+	return ioread32(ah->ah_sh + reg);
+}
+
+static inline void ath9k_hw_reg_write(struct ath_hal *ah, u_int32_t reg,
+				      u_int32_t val)
+{
+	if (unlikely(ah->ah_shadow != NULL))
+		ath9k_hw_shadow_write(ah, reg, val);
+	else
+		iowrite32(val, ah->ah_sh + reg);
+}
+#else
+static inline void ath9k_hw_shadow_attach(struct ath_hal *ah) {}
+static inline void ath9k_hw_shadow_detach(struct ath_hal *ah) {}
+static inline void ath9k_hw_shadow_buffer(struct ath_hal *ah,
+					  enum hal_bool enable) {}
+static inline void ath9k_hw_shadow_flush(struct ath_hal *ah) {}
+static inline void ath9k_hw_shadow_invalidate(struct ath_hal *ah) {}
+static inline void ath9k_hw_shadow_reset(struct ath_hal *ah,
+					 enum hal_bool done) {}
+static inline void ath9k_hw_shadow_getstats(struct ath_hal *ah,
+					    struct hal_reg_stats *total,
+					    struct hal_reg_stats *reset)
+{
+	memset(total, 0, sizeof(*total));
+	memset(reset, 0, sizeof(*reset));
+}
+static inline enum hal_bool
+ath9k_hw_profile_replay(struct ath_hal *ah, struct hal_channel *chan,
+			struct hal_channel_internal *ichan,
+			enum hal_ht_macmode macmode)
+{
+	return AH_FALSE;
+}
+static inline void ath9k_hw_profile_record(struct ath_hal *ah) {}
+static inline void ath9k_hw_profile_save(struct ath_hal *ah,
+					 enum hal_bool ok) {}
+static inline void ath9k_hw_profile_flush(struct ath_hal *ah) {}
+static inline void ath9k_hw_profile_getstats(struct ath_hal *ah,
+					     struct hal_prof_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+#endif /* CONFIG_ATH9K_REGSHADOW */
+
 #endif
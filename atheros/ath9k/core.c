@@ -31,6 +31,75 @@ static u_int32_t ath_chainmask_sel_down_rssi_thres =
 static u_int32_t ath_chainmask_sel_period =
 	ATH_CHAINMASK_SEL_TIMEOUT;
 
+static int ath9k_airtime_fair;
+module_param_named(airtime, ath9k_airtime_fair, int, 0444);
+MODULE_PARM_DESC(airtime, "Schedule aggregates by airtime deficit");
+
+static int ath9k_aggr_adapt;
+module_param_named(aggr_adapt, ath9k_aggr_adapt, int, 0444);
+MODULE_PARM_DESC(aggr_adapt, "Size aggregates from block-ack error rate");
+
+static int ath9k_intr_coalesce;
+module_param_named(intr_coalesce, ath9k_intr_coalesce, int, 0444);
+MODULE_PARM_DESC(intr_coalesce, "Coalesce interrupts when traffic is heavy");
+
+static int ath9k_intr_txframes = ATH_INTR_TXFRAMES;
+module_param_named(intr_txframes, ath9k_intr_txframes, int, 0444);
+MODULE_PARM_DESC(intr_txframes, "Tx frames per interrupt when coalescing");
+
+static int ath9k_intr_rxusecs = ATH_INTR_RXUSECS;
+module_param_named(intr_rxusecs, ath9k_intr_rxusecs, int, 0444);
+MODULE_PARM_DESC(intr_rxusecs, "Rx quiet usecs before interrupt "
+		 "when coalescing");
+
+static int ath9k_intr_hirate = ATH_INTR_HIRATE;
+module_param_named(intr_hirate, ath9k_intr_hirate, int, 0444);
+MODULE_PARM_DESC(intr_hirate, "Frames/sec above which to coalesce");
+
+static int ath9k_rx_budget = ATH_RX_BUDGET;
+module_param_named(rx_budget, ath9k_rx_budget, int, 0444);
+MODULE_PARM_DESC(rx_budget, "Frames per rx poll, 0 to drain the ring");
+
+static int ath9k_rx_copybreak = ATH_RX_COPYBREAK;
+module_param_named(rx_copybreak, ath9k_rx_copybreak, int, 0444);
+MODULE_PARM_DESC(rx_copybreak, "Copy received frames shorter than this, "
+		 "0 to disable");
+
+static int ath9k_tx_linearize;
+module_param_named(tx_linearize, ath9k_tx_linearize, int, 0444);
+MODULE_PARM_DESC(tx_linearize, "Copy fragmented tx frames into one "
+		 "buffer instead of mapping each page");
+
+static int ath9k_tx_amsdu;
+module_param_named(tx_amsdu, ath9k_tx_amsdu, int, 0444);
+MODULE_PARM_DESC(tx_amsdu, "Pack small frames queued for an aggregation "
+		 "session into A-MSDUs");
+
+static int ath9k_tx_scanhold;
+module_param_named(tx_scanhold, ath9k_tx_scanhold, int, 0444);
+MODULE_PARM_DESC(tx_scanhold, "Keep queued tx frames over scan channel "
+		 "visits instead of failing them");
+
+static int ath9k_cal_async;
+module_param_named(cal_async, ath9k_cal_async, int, 0444);
+MODULE_PARM_DESC(cal_async, "Poll calibration from a timer instead of "
+		 "busy-waiting in the reset path (rx starts before the "
+		 "reset's offset cal is done)");
+
+/*
+ * Fit a load-time parameter into the range of its ath_config field,
+ * warning when the value asked for had to be changed.
+ */
+static int ath_param_clamp(const char *name, int val, int min, int max)
+{
+	int v = clamp(val, min, max);
+
+	if (v != val)
+		printk(KERN_WARNING "ath9k: %s %d out of range, using %d\n",
+		       name, val, v);
+	return v;
+}
+
 /* return bus cachesize in 4B word units */
 
 static void bus_read_cachesize(struct ath_softc *sc, int *csz)
@@ -279,6 +348,83 @@ static void ath_chan_change(struct ath_softc *sc, struct hal_channel *chan)
 	ath_setcurmode(sc, mode);
 }
 
+/*
+ * Calibration
+ *
+ * ath9k_hw_calibrate() is stepped from a timer.  Each step only looks
+ * at the hardware: when a measurement or an NF load is still running
+ * the HAL reports it pending and we come back on the next tick rather
+ * than spinning, otherwise the next step is a short (periodic cals
+ * still running) or long (noise floor) interval away.  An offset cal
+ * the reset left running that never completes fails the reset after
+ * the fact, so the chip is reset again.
+ */
+
+static void ath_cal_timer(unsigned long data)
+{
+	struct ath_softc *sc = (struct ath_softc *)data;
+	struct ath_hal *ah = sc->sc_ah;
+	enum hal_bool longcal = AH_FALSE, isCalDone = AH_TRUE;
+	enum hal_status status;
+	unsigned long now = jiffies, next;
+
+	if (sc->sc_invalid)
+		return;
+
+	spin_lock(&sc->sc_resetlock);
+	if (time_after_eq(now, sc->sc_restartcal)) {
+		ath9k_hw_reset_calvalid(ah, &sc->sc_curchan, &isCalDone);
+		sc->sc_restartcal = now +
+			msecs_to_jiffies(ATH_RESTART_CALINTERVAL);
+	}
+	if (ath9k_hw_cal_status(ah) == HAL_OK &&
+	    time_after_eq(now, sc->sc_longcal)) {
+		longcal = AH_TRUE;
+		sc->sc_longcal = now + msecs_to_jiffies(ATH_LONG_CALINTERVAL);
+	}
+
+	if (!ath9k_hw_calibrate(ah, &sc->sc_curchan, sc->sc_rx_chainmask,
+				longcal, &isCalDone))
+		DPRINTF(sc, ATH_DEBUG_CONFIG,
+			"%s: calibration of channel %u failed\n",
+			__func__, sc->sc_curchan.channel);
+
+	status = ath9k_hw_cal_status(ah);
+	if (status == HAL_ESELFTEST) {
+		spin_unlock(&sc->sc_resetlock);
+		DPRINTF(sc, ATH_DEBUG_FATAL,
+			"%s: offset calibration of channel %u timed out, "
+			"resetting\n", __func__, sc->sc_curchan.channel);
+		ath_internal_reset(sc);
+		return;
+	}
+
+	if (status == HAL_EINPROGRESS)
+		next = now + 1;
+	else if (!isCalDone)
+		next = now + msecs_to_jiffies(ATH_SHORT_CALINTERVAL);
+	else
+		next = sc->sc_longcal;
+	spin_unlock(&sc->sc_resetlock);
+
+	mod_timer(&sc->sc_cal_timer, next);
+}
+
+/* (Re)start calibration after the chip has been reset */
+static void ath_cal_start(struct ath_softc *sc)
+{
+	unsigned long now = jiffies;
+
+	sc->sc_longcal = now + msecs_to_jiffies(ATH_LONG_CALINTERVAL);
+	sc->sc_restartcal = now + msecs_to_jiffies(ATH_RESTART_CALINTERVAL);
+	mod_timer(&sc->sc_cal_timer, now + 1);
+}
+
+static void ath_cal_stop(struct ath_softc *sc)
+{
+	del_timer_sync(&sc->sc_cal_timer);
+}
+
 /*
  * Stop the device, grabbing the top-level lock to protect
  * against concurrent entry through ath_init (which can happen
@@ -309,9 +455,11 @@ static int ath_stop(struct ath_softc *sc)
 	 * hardware is gone (invalid).
 	 */
 
+	ath_cal_stop(sc);
 	if (!sc->sc_invalid)
 		ath9k_hw_set_interrupts(ah, 0);
 	ath_draintxq(sc, AH_FALSE);
+	ath_tx_unhold(sc, NULL);
 	if (!sc->sc_invalid) {
 		ath_stoprecv(sc);
 		ath9k_hw_phy_disable(ah);
@@ -365,6 +513,9 @@ void ath_scan_end(struct ath_softc *sc)
 	ath9k_hw_setrxfilter(ah, rfilt);
 	ath9k_hw_write_associd(ah, sc->sc_curbssid, sc->sc_curaid);
 
+	/* tx held over the scan, if we are back where it was queued */
+	ath_tx_unhold(sc, &sc->sc_curchan);
+
 	DPRINTF(sc, ATH_DEBUG_CONFIG, "%d.%03d | %s: RX filter 0x%x aid 0x%x\n",
 		now / 1000, now % 1000, __func__, rfilt, sc->sc_curaid);
 }
@@ -408,9 +559,13 @@ int ath_set_channel(struct ath_softc *sc, struct hal_channel *hchan)
 		 * wait long enough for the RX fifo to drain, reset the
 		 * hardware at the new frequency, and then re-enable
 		 * the relevant bits of the h/w.
+		 *
+		 * While scanning, queued tx frames may instead be held
+		 * until we are back on this channel, see ath_tx_hold().
 		 */
 		ath9k_hw_set_interrupts(ah, 0);	/* disable interrupts */
-		ath_draintxq(sc, AH_FALSE);	/* clear pending tx frames */
+		if (!ath_tx_hold(sc))
+			ath_draintxq(sc, AH_FALSE); /* clear pending tx */
 		stopped = ath_stoprecv(sc);	/* turn off frame recv */
 
 		/* XXX: do not flush receive queue here. We don't want
@@ -420,6 +575,9 @@ int ath_set_channel(struct ath_softc *sc, struct hal_channel *hchan)
 		if (!stopped || sc->sc_full_reset)
 			fastcc = AH_FALSE;
 
+		/* no calibration step against the old channel */
+		ath_cal_stop(sc);
+
 		spin_lock_bh(&sc->sc_resetlock);
 		if (!ath9k_hw_reset(ah, sc->sc_opmode, hchan,
 					ht_macmode, sc->sc_tx_chainmask,
@@ -457,6 +615,9 @@ int ath_set_channel(struct ath_softc *sc, struct hal_channel *hchan)
 		 * Re-enable interrupts.
 		 */
 		ath9k_hw_set_interrupts(ah, sc->sc_imask);
+
+		ath_tx_unhold(sc, hchan);
+		ath_cal_start(sc);
 	}
 	return 0;
 }
@@ -1072,6 +1233,7 @@ int ath_open(struct ath_softc *sc, struct hal_channel *initial_chan)
 	/* XXX: we must make sure h/w is ready and clear invalid flag
 	 * before turning on interrupt. */
 	sc->sc_invalid = 0;
+	ath_cal_start(sc);
 done:
 	return error;
 }
@@ -1151,6 +1313,8 @@ int ath_reset(struct ath_softc *sc)
 	}
 	spin_unlock_bh(&sc->sc_resetlock);
 
+	if (!error)
+		ath_cal_start(sc);
 	return error;
 }
 
@@ -1164,6 +1328,7 @@ int ath_suspend(struct ath_softc *sc)
 
 	/* Shut off the interrupt before setting sc->sc_invalid to '1' */
 	ath9k_hw_set_interrupts(ah, 0);
+	ath_cal_stop(sc);
 
 	/* XXX: we must make sure h/w will not generate any interrupt
 	 * before setting the invalid flag. */
@@ -1218,6 +1383,7 @@ int ath_intr(struct ath_softc *sc)
 			return ATH_ISR_NOTMINE;
 
 		sc->sc_intrstatus = status;
+		sc->sc_intrcoal.wintr++;
 
 		if (status & HAL_INT_FATAL) {
 			/* need a chip reset */
@@ -1290,12 +1456,69 @@ int ath_intr(struct ath_softc *sc)
 
 }
 
+/*
+ * Interrupt coalescing.
+ *
+ * Interrupt and frame rates are sampled every ATH_INTR_WINDOW. Above
+ * intr_hirate frames/sec we switch to bulk mode: only every
+ * intr_txframes-th tx descriptor asks for an interrupt (EOL still
+ * reaps a queue that goes idle) and rx interrupts are held off by the
+ * h/w mitigation timers. Below half that rate we go back to one
+ * interrupt per frame for latency.
+ */
+
+static void ath_intr_coalesce(struct ath_softc *sc)
+{
+	struct ath_intr_coalesce *ic = &sc->sc_intrcoal;
+	unsigned long elapsed = jiffies - ic->window;
+	enum ath_intr_mode mode;
+
+	if (elapsed < ATH_INTR_WINDOW)
+		return;
+
+	ic->intr_rate = ic->wintr * HZ / elapsed;
+	ic->frame_rate = ic->wframes * HZ / elapsed;
+	ic->intr += ic->wintr;
+	ic->frames += ic->wframes;
+	ic->wintr = ic->wframes = 0;
+	ic->window = jiffies;
+
+	if (!sc->sc_config.intr_coalesce)
+		return;
+
+	mode = ic->mode;
+	if (ic->frame_rate > sc->sc_config.intr_hirate)
+		mode = ATH_INTR_BULK;
+	else if (ic->frame_rate < sc->sc_config.intr_hirate / 2)
+		mode = ATH_INTR_LOWLAT;
+	if (mode == ic->mode)
+		return;
+
+	ic->mode = mode;
+	ic->switches++;
+	if (mode == ATH_INTR_BULK) {
+		sc->sc_txintrperiod = sc->sc_config.intr_txframes;
+		ath9k_hw_set_rxmitigation(sc->sc_ah,
+					  sc->sc_config.intr_rxusecs,
+					  4 * sc->sc_config.intr_rxusecs);
+	} else {
+		sc->sc_txintrperiod = 1;
+		ath9k_hw_set_rxmitigation(sc->sc_ah, 0, 0);
+	}
+
+	DPRINTF(sc, ATH_DEBUG_CONFIG, "%s: %s mode, %u frames/s %u intr/s\n",
+		__func__, mode == ATH_INTR_BULK ? "bulk" : "low latency",
+		ic->frame_rate, ic->intr_rate);
+}
+
 /* Deferred interrupt processing  */
 
 static void ath9k_tasklet(unsigned long data)
 {
 	struct ath_softc *sc = (struct ath_softc *)data;
 	u_int32_t status = sc->sc_intrstatus;
+	cycles_t start;
+	int n;
 
 	if (status & HAL_INT_FATAL) {
 		/* need a chip reset */
@@ -1303,7 +1526,8 @@ static void ath9k_tasklet(unsigned long data)
 		return;
 	} else {
 
-		if (status & (HAL_INT_RX | HAL_INT_RXEOL | HAL_INT_RXORN)) {
+		if ((status & (HAL_INT_RX | HAL_INT_RXEOL | HAL_INT_RXORN)) ||
+		    sc->sc_rxpoll) {
 			/* XXX: fill me in */
 			/*
 			if (status & HAL_INT_RXORN) {
@@ -1311,9 +1535,14 @@ static void ath9k_tasklet(unsigned long data)
 			if (status & HAL_INT_RXEOL) {
 			}
 			*/
+			start = ath9k_debug_cycles();
 			spin_lock_bh(&sc->sc_rxflushlock);
-			ath_rx_tasklet(sc, 0);
+			n = ath_rx_tasklet(sc, 0, sc->sc_config.rx_budget);
 			spin_unlock_bh(&sc->sc_rxflushlock);
+			sc->sc_rxpoll = sc->sc_config.rx_budget &&
+				n >= sc->sc_config.rx_budget;
+			ath9k_debug_rxpoll(sc, sc->sc_rxpoll,
+					   ath9k_debug_cycles() - start);
 		}
 		/* XXX: optimize this */
 		if (status & HAL_INT_TX)
@@ -1331,6 +1560,22 @@ static void ath9k_tasklet(unsigned long data)
 		*/
 	}
 
+	ath_intr_coalesce(sc);
+
+	if (sc->sc_rxpoll) {
+		/*
+		 * The rx budget ran out with frames still on the ring.
+		 * Leave rx interrupts masked and poll again from a fresh
+		 * tasklet run, so tx completion, beacons and other
+		 * softirqs get their turn in between.
+		 */
+		sc->sc_intrstatus = 0;
+		ath9k_hw_set_interrupts(sc->sc_ah,
+					sc->sc_imask & ~HAL_INT_RX);
+		tasklet_schedule(&sc->intr_tq);
+		return;
+	}
+
 	/* re-enable hardware interrupt */
 	ath9k_hw_set_interrupts(sc->sc_ah, sc->sc_imask);
 }
@@ -1358,6 +1603,7 @@ int ath_init(u_int16_t devid, struct ath_softc *sc)
 	tasklet_init(&sc->intr_tq, ath9k_tasklet, (unsigned long)sc);
 	tasklet_init(&sc->bcon_tasklet, ath9k_beacon_tasklet,
 		     (unsigned long)sc);
+	setup_timer(&sc->sc_cal_timer, ath_cal_timer, (unsigned long)sc);
 
 	/*
 	 * Cache line size is used to size and align various
@@ -1625,6 +1871,31 @@ int ath_init(u_int16_t devid, struct ath_softc *sc)
 
 	/* save MISC configurations */
 	sc->sc_config.swBeaconProcess = 1;
+	sc->sc_config.airtime_fair = ath9k_airtime_fair;
+	sc->sc_config.aggr_adapt = ath9k_aggr_adapt;
+	sc->sc_config.intr_coalesce = ath9k_intr_coalesce;
+	sc->sc_config.intr_txframes =
+		ath_param_clamp("intr_txframes", ath9k_intr_txframes,
+				1, 0xffff);
+	sc->sc_config.intr_rxusecs =
+		ath_param_clamp("intr_rxusecs", ath9k_intr_rxusecs,
+				0, 0xffff);
+	sc->sc_config.intr_hirate = ath9k_intr_hirate;
+	sc->sc_config.rx_budget =
+		ath_param_clamp("rx_budget", ath9k_rx_budget, 0, 0xffff);
+	sc->sc_config.rx_copybreak =
+		ath_param_clamp("rx_copybreak", ath9k_rx_copybreak,
+				0, 0xffff);
+	sc->sc_config.tx_linearize = !!ath9k_tx_linearize;
+	sc->sc_config.tx_amsdu = !!ath9k_tx_amsdu;
+	sc->sc_config.tx_scanhold = !!ath9k_tx_scanhold;
+	sc->sc_config.cal_async = !!ath9k_cal_async;
+	ah->ah_config.ath_hal_calAsync = sc->sc_config.cal_async;
+	sc->sc_txintrperiod = 1;
+	sc->sc_intrcoal.mode = ATH_INTR_LOWLAT;
+	sc->sc_intrcoal.window = jiffies;
+	if (sc->sc_config.intr_coalesce)
+		ath9k_hw_set_rxmitigation(ah, 0, 0);
 
 #ifdef CONFIG_SLOW_ANT_DIV
 	sc->sc_slowAntDiv = 1;
@@ -1661,6 +1932,8 @@ void ath_deinit(struct ath_softc *sc)
 	for (i = 0; i < HAL_NUM_TX_QUEUES; i++)
 		if (ATH_TXQ_SETUP(sc, i))
 			ath_tx_cleanupq(sc, &sc->sc_txq[i]);
+	/* nodes still queued for an rcu free reference sc */
+	rcu_barrier();
 	ath9k_hw_detach(ah);
 }
 
@@ -1694,6 +1967,8 @@ struct ath_node *ath_node_attach(struct ath_softc *sc, u8 *addr, int if_id)
 	ath_chainmask_sel_init(sc, an);
 	ath_chainmask_sel_timerstart(&an->an_chainmask_sel);
 	list_add(&an->list, &sc->node_list);
+	hlist_add_head_rcu(&an->an_hash,
+			   &sc->sc_nodehash[ATH_NODE_HASH(an->an_addr)]);
 
 	DPRINTF(sc, ATH_DEBUG_NODE, "%s: an %p for: %s\n",
 		__func__, an, print_mac(mac, addr));
@@ -1701,49 +1976,79 @@ struct ath_node *ath_node_attach(struct ath_softc *sc, u8 *addr, int if_id)
 	return an;
 }
 
+/*
+ * Runs once no rx path reader can still be using the node found
+ * through the hash, so the subframes it still holds can go.
+ */
+static void ath_node_free_rcu(struct rcu_head *head)
+{
+	struct ath_node *an = container_of(head, struct ath_node, an_rcu);
+	struct ath_softc *sc = an->an_sc;
+
+	ath_tx_node_free(sc, an);
+	ath_rx_node_free(sc, an);
+	kfree(an);
+}
+
 void ath_node_detach(struct ath_softc *sc, struct ath_node *an, bool bh_flag)
 {
+	struct ath_vap *avp;
 	unsigned long flags;
+	int i;
 
 	DECLARE_MAC_BUF(mac);
 
 	ath_chainmask_sel_timerstop(&an->an_chainmask_sel);
 	an->an_flags |= ATH_NODE_CLEAN;
-	ath_tx_node_cleanup(sc, an, bh_flag);
-	ath_rx_node_cleanup(sc, an);
-
-	ath_tx_node_free(sc, an);
-	ath_rx_node_free(sc, an);
 
+	/* unhash first, no new lookup finds the node past this point */
 	spin_lock_irqsave(&sc->node_lock, flags);
 
 	list_del(&an->list);
+	hlist_del_rcu(&an->an_hash);
+
+	/*
+	 * The tx path only caches a node while holding a reference, and
+	 * the last one is gone by now, so nobody can put it back.
+	 */
+	for (i = 0; i < ATH_BCBUF; i++) {
+		avp = sc->sc_vaps[i];
+		if (avp != NULL && avp->av_txnode == an)
+			rcu_assign_pointer(avp->av_txnode, NULL);
+	}
 
 	spin_unlock_irqrestore(&sc->node_lock, flags);
 
+	/* tx holds references, so nothing else queues to the node now */
+	ath_tx_node_cleanup(sc, an, bh_flag);
+
+	/*
+	 * The reorder release engine reaches tids through sc_rxreorder,
+	 * not the hash, so they must be off that list before call_rcu()
+	 */
+	ath_rx_node_detach(sc, an);
+
 	DPRINTF(sc, ATH_DEBUG_NODE, "%s: an %p for: %s\n",
 		__func__, an, print_mac(mac, an->an_addr));
 
-	kfree(an);
+	/* lockless rx readers may still be using the node */
+	call_rcu(&an->an_rcu, ath_node_free_rcu);
 }
 
-/* Finds a node and increases the refcnt if found */
+/*
+ * Finds a node and increases the refcnt if found. A node whose last
+ * reference is already gone is being detached and is not revived.
+ */
 
 struct ath_node *ath_node_get(struct ath_softc *sc, u8 *addr)
 {
-	struct ath_node *an = NULL, *an_found = NULL;
+	struct ath_node *an;
 
-	if (list_empty(&sc->node_list)) /* FIXME */
-		goto out;
-	list_for_each_entry(an, &sc->node_list, list) {
-		if (!compare_ether_addr(an->an_addr, addr)) {
-			atomic_inc(&an->an_refcnt);
-			an_found = an;
-			break;
-		}
-	}
-out:
-	return an_found;
+	an = ath_node_find(sc, addr);
+	if (an != NULL && !atomic_inc_not_zero(&an->an_refcnt))
+		an = NULL;
+
+	return an;
 }
 
 /* Decrements the refcnt and if it drops to zero, detach the node */
@@ -1754,21 +2059,64 @@ void ath_node_put(struct ath_softc *sc, struct ath_node *an, bool bh_flag)
 		ath_node_detach(sc, an, bh_flag);
 }
 
-/* Finds a node, doesn't increment refcnt. Caller must hold sc->node_lock */
+/*
+ * Finds a node, doesn't increment refcnt. Caller must hold sc->node_lock,
+ * or be inside rcu_read_lock() if it only needs the node until unlock.
+ */
 struct ath_node *ath_node_find(struct ath_softc *sc, u8 *addr)
 {
-	struct ath_node *an = NULL, *an_found = NULL;
+	struct ath_node *an;
+	struct hlist_node *pos;
 
-	if (list_empty(&sc->node_list))
-		return NULL;
+	hlist_for_each_entry_rcu(an, pos,
+				 &sc->sc_nodehash[ATH_NODE_HASH(addr)], an_hash)
+		if (!compare_ether_addr(an->an_addr, addr))
+			return an;
 
-	list_for_each_entry(an, &sc->node_list, list)
-		if (!compare_ether_addr(an->an_addr, addr)) {
-			an_found = an;
-			break;
-		}
+	return NULL;
+}
+
+/*
+ * Finds the destination node of an outgoing frame and takes a reference.
+ *
+ * Each vap remembers the node it last sent to, so a stream of frames to
+ * one peer costs a mac compare instead of a hash walk, and neither takes
+ * node_lock. Only when the peer is unknown, or its node is being
+ * detached, is the lock taken to attach a fresh temporary node.
+ */
+struct ath_node *ath_node_tx_get(struct ath_softc *sc, int if_id, u8 *addr)
+{
+	struct ath_vap *avp = sc->sc_vaps[if_id];
+	struct ath_node *an;
+	cycles_t start = ath9k_debug_cycles();
+	int cached = 0;
+
+	rcu_read_lock();
+	an = avp ? rcu_dereference(avp->av_txnode) : NULL;
+	if (an != NULL && !compare_ether_addr(an->an_addr, addr))
+		cached = 1;
+	else
+		an = ath_node_find(sc, addr);
+
+	/* a node whose last reference is gone is on its way out */
+	if (an != NULL && !atomic_inc_not_zero(&an->an_refcnt))
+		an = NULL;
+	if (an != NULL && !cached && avp != NULL)
+		rcu_assign_pointer(avp->av_txnode, an);
+	rcu_read_unlock();
+
+	ath9k_debug_txnode(sc, cached, ath9k_debug_cycles() - start);
+	if (an != NULL)
+		return an;
+
+	/* create a temp node, if the node is not there already */
+	spin_lock_bh(&sc->node_lock);
+	an = ath_node_get(sc, addr);
+	if (!an)
+		an = ath_node_attach(sc, addr, if_id);
+	spin_unlock_bh(&sc->node_lock);
 
-	return an_found;
+	return an;
 }
 
 /*
@@ -1794,6 +2142,8 @@ void ath_newassoc(struct ath_softc *sc,
 		}
 	}
 	an->an_flags = 0;
+	if (sc->sc_config.tx_amsdu)
+		an->an_flags |= ATH_NODE_AMSDU;
 }
 
 /**************/
@@ -2108,6 +2458,10 @@ int ath_descdma_setup(struct ath_softc *sc,
 		}
 		list_add_tail(&bf->list, head);
 	}
+
+	/* let the chip model resolve descriptor addresses */
+	ath9k_hw_sim_addregion(sc->sc_ah, dd->dd_desc,
+			       dd->dd_desc_paddr, dd->dd_desc_len);
 	return 0;
 fail2:
 	pci_free_consistent(sc->pdev,
@@ -2132,6 +2486,8 @@ void ath_descdma_cleanup(struct ath_softc *sc,
 			 struct ath_descdma *dd,
 			 struct list_head *head)
 {
+	ath9k_hw_sim_delregion(sc->sc_ah, dd->dd_desc);
+
 	/* Free memory associated with descriptors */
 	pci_free_consistent(sc->pdev,
 		dd->dd_desc_len, dd->dd_desc, dd->dd_desc_paddr);
@@ -35,6 +35,10 @@
 #include <linux/interrupt.h>
 #include <linux/sched.h>
 #include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/timex.h>
 #include <asm/byteorder.h>
 #include <linux/scatterlist.h>
 #include <asm/page.h>
@@ -207,6 +211,80 @@ enum ATH_DEBUG {
 			printk(_fmt , ##__VA_ARGS__);	\
 	} while (0)
 
+/* Points at which a tx frame is timestamped on its way to the hardware */
+enum ath_txlat_stamp {
+	ATH_TXLAT_ENQ,		/* handed to ath_tx_start */
+	ATH_TXLAT_DEQ,		/* taken off the tid software queue */
+	ATH_TXLAT_HWQ,		/* linked on the h/w txq */
+	ATH_TXLAT_NSTAMP
+};
+
+#ifdef CONFIG_ATH9K_DEBUG
+
+struct ath_txlat;
+
+/* rx reorder hold time histogram, bucket n < 2^n usec, the last is open */
+#define ATH_RXHOLD_NBUCKETS	18
+
+struct ath_rx_stats {
+	u_int64_t frames;	/* descriptors completed */
+	u_int64_t bytes;
+	u_int64_t batches;
+	u_int64_t cycles;	/* spent from harvest to delivery */
+	u_int64_t polls;	/* rx tasklet passes */
+	u_int64_t exhausted;	/* passes that used up the budget */
+	u_int64_t poll_cycles;
+	u_int64_t allocs;	/* rx buffers allocated and mapped */
+	u_int64_t recycled;	/* rx buffers reused from the stack */
+	u_int64_t copied;	/* small frames copied, buffer kept */
+	u_int64_t copied_bytes;
+	u_int64_t reorder_timeouts;	/* holes given up on */
+	u_int64_t reorder_runs;		/* in-order runs released */
+	u_int64_t reorder_frames;	/* ... and the frames in them */
+	u_int64_t hold[ATH_RXHOLD_NBUCKETS];	/* reorder hold time, log2 */
+};
+
+struct ath_tx_stats {
+	u_int64_t sg_frames;	/* frames sent from page fragments */
+	u_int64_t sg_segs;	/* descriptors used by those frames */
+	u_int64_t linearized;	/* nonlinear frames copied instead */
+	u_int64_t node_lookups;	/* tx destinations resolved */
+	u_int64_t node_cached;	/* ... from the vap's last-hit slot */
+	u_int64_t node_cycles;
+	u_int64_t aggr_forms;	/* ath_tx_form_aggr() calls that built one */
+	u_int64_t aggr_subframes;
+	u_int64_t aggr_cycles;
+	u_int64_t amsdu_mpdus;	/* A-MSDUs built in software */
+	u_int64_t amsdu_msdus;	/* MSDUs carried by them */
+	u_int64_t kicks;	/* tx doorbells rung */
+	u_int64_t kick_frames;	/* frames handed over by them */
+	u_int64_t kick_mmio;	/* TXDP and TxE writes they cost */
+	u_int64_t hold_visits;	/* off-channel visits that held tx */
+	u_int64_t hold_units;	/* frames/aggregates taken off the hw */
+	u_int64_t hold_requeued; /* ... and given back on return */
+	u_int64_t hold_dropped;	/* ... and failed, never returned */
+};
+
+struct ath9k_debug {
+	struct dentry *debugfs_phy;
+	struct dentry *debugfs_txlat;
+	struct dentry *debugfs_airtime;
+	struct dentry *debugfs_aggr;
+	struct dentry *debugfs_rx;
+	struct dentry *debugfs_nodes;
+	struct dentry *debugfs_txbuf;
+	struct dentry *debugfs_intr;
+	struct dentry *debugfs_regs;
+	struct dentry *debugfs_cal;
+	struct dentry *debugfs_resettrace;
+	struct dentry *debugfs_sim;
+	struct ath_rx_stats rx;
+	struct ath_tx_stats tx;
+	struct ath_txlat *txlat;	/* per-cpu latency histograms */
+};
+
+#endif /* CONFIG_ATH9K_DEBUG */
+
 /***************************/
 /* Load-time Configuration */
 /***************************/
@@ -221,6 +299,22 @@ struct ath_config {
 	u_int8_t    cabqReadytime; /* Cabq Readytime % */
 	u_int8_t    swBeaconProcess; /* Process received beacons
 					in SW (vs HW) */
+	u_int8_t    airtime_fair; /* schedule aggregates by airtime
+					deficit instead of round robin */
+	u_int8_t    aggr_adapt; /* size aggregates from block-ack PER */
+	u_int8_t    intr_coalesce; /* adapt interrupt coalescing to load */
+	u_int16_t   intr_txframes; /* tx frames per interrupt when busy */
+	u_int16_t   intr_rxusecs; /* rx quiet time before intr when busy */
+	u_int32_t   intr_hirate; /* frames/sec above which to coalesce */
+	u_int16_t   rx_budget; /* frames per rx poll, 0 drains all */
+	u_int16_t   rx_copybreak; /* copy rx frames below this length */
+	u_int8_t    tx_linearize; /* copy nonlinear tx frames into one
+					buffer instead of chaining */
+	u_int8_t    tx_amsdu; /* pack small tx MSDUs into A-MSDUs */
+	u_int8_t    tx_scanhold; /* keep queued tx across scan channel
+					visits instead of draining */
+	u_int8_t    cal_async; /* leave calibration hw waits to the
+					cal timer instead of spinning */
 };
 
 /***********************/
@@ -254,6 +348,8 @@ int ath_chainmask_sel_logic(struct ath_softc *sc, struct ath_node *an);
 /* Descriptor Management */
 /*************************/
 
+/* Max segments (linear head + page fragments) chained for one frame */
+#define ATH_TX_MAXSEGS      8
 /* Number of descriptors per buffer. The only case where we see skbuff
 chains is due to FF aggregation in the driver. */
 #define	ATH_TXDESC	    1
@@ -291,6 +387,10 @@ struct ath_buf_state {
 	int bfs_rifsburst_elem;	/* RIFS burst/bar */
 	int bfs_nrifsubframes;	/* # of elements in burst */
 	enum hal_key_type bfs_keytype;	/* key type use to encrypt this frame */
+	int bfs_nfrags;		/* page fragments mapped behind the head */
+#ifdef CONFIG_ATH9K_DEBUG
+	u_int32_t bfs_txlat[ATH_TXLAT_NSTAMP];	/* stage timestamps (usec) */
+#endif
 };
 
 #define bf_nframes      	bf_state.bfs_nframes
@@ -310,10 +410,12 @@ struct ath_buf_state {
 #define bf_rifsburst_elem  	bf_state.bfs_rifsburst_elem
 #define bf_nrifsubframes  	bf_state.bfs_nrifsubframes
 #define bf_keytype      	bf_state.bfs_keytype
+#define bf_nfrags       	bf_state.bfs_nfrags
 #define bf_isbar        	bf_state.bfs_isbar
 #define bf_ispspoll     	bf_state.bfs_ispspoll
 #define bf_aggrburst    	bf_state.bfs_aggrburst
 #define bf_calcairtime  	bf_state.bfs_calcairtime
+#define bf_txlat        	bf_state.bfs_txlat
 
 /*
  * Abstraction of a contiguous buffer to transmit/receive.  There is only
@@ -337,6 +439,8 @@ struct ath_buf {
 	u_int16_t bf_flags;		/* tx descriptor flags */
 	struct ath_buf_state bf_state;	/* buffer state */
 	dma_addr_t bf_dmacontext;
+	dma_addr_t bf_fragaddr[ATH_TX_MAXSEGS - 1]; /* page fragment
+						mappings, first buf only */
 };
 
 /*
@@ -352,8 +456,6 @@ struct ath_buf {
 #define ATH_BUFSTATUS_DONE      0x00000001
 /* hw processing complete, desc hold for hw */
 #define ATH_BUFSTATUS_STALE     0x00000002
-/* Rx-only: OS is done with this packet and it's ok to queued it to hw */
-#define ATH_BUFSTATUS_FREE      0x00000004
 
 /* DMA state for tx/rx descriptors */
 
@@ -366,13 +468,6 @@ struct ath_descdma {
 	dma_addr_t dd_dmacontext;
 };
 
-/* Abstraction of a received RX MPDU/MMPDU, or a RX fragment */
-
-struct ath_rx_context {
-	struct ath_buf *ctx_rxbuf;	/* associated ath_buf for rx */
-};
-#define ATH_RX_CONTEXT(skb) ((struct ath_rx_context *)skb->cb)
-
 int ath_descdma_setup(struct ath_softc *sc,
 		      struct ath_descdma *dd,
 		      struct list_head *head,
@@ -390,8 +485,16 @@ void ath_desc_swap(struct ath_desc *ds);
 /* RX */
 /******/
 
+/* block-ack window and per-tid frame slots, shared with tx */
+#define WME_BA_BMP_SIZE         64
+#define WME_MAX_BA              WME_BA_BMP_SIZE
+#define ATH_TID_MAX_BUFS        (2 * WME_MAX_BA)
 #define ATH_MAX_ANTENNA          3
 #define ATH_RXBUF                512
+#define ATH_RX_BATCH             16      /* frames per rxbuf lock round */
+#define ATH_RX_BUDGET            64      /* frames per rx poll */
+#define ATH_RX_RECYCLE           64      /* buffers lent to the stack */
+#define ATH_RX_COPYBREAK         256     /* copy frames shorter than this */
 #define ATH_RX_TIMEOUT           40      /* 40 milliseconds */
 #define WME_NUM_TID              16
 #define IEEE80211_BAR_CTL_TID_M  0xF000  /* tid mask */
@@ -430,15 +533,21 @@ struct ath_recv_status {
 
 struct ath_rxbuf {
 	struct sk_buff         		*rx_wbuf; /* buffer */
-	unsigned long               	rx_time; /* system time when received */
+	unsigned long               	rx_time; /* jiffies when received */
 	struct ath_recv_status   	rx_status; /* cached rx status */
+#ifdef CONFIG_ATH9K_DEBUG
+	u_int32_t			rx_held; /* usec when put on hold */
+#endif
 };
 
 /* Per-TID aggregate receiver state for a node */
 struct ath_arx_tid {
 	struct ath_node     *an;        /* parent ath node */
 	struct ath_rxbuf    *rxbuf; 	/* re-ordering buffer */
-	struct timer_list   timer;
+	unsigned long       held[BITS_TO_LONGS(ATH_TID_MAX_BUFS)]; /* rxbuf
+						slots holding a frame */
+	struct list_head    reorder;    /* on sc_rxreorder while holding */
+	unsigned long       expire;     /* release time of first held frame */
 	spinlock_t          tidlock;    /* lock to protect this TID structure */
 	int                 baw_head;   /* seq_next at head */
 	int                 baw_tail;   /* tail of block-ack window */
@@ -461,20 +570,38 @@ u_int32_t ath_calcrxfilter(struct ath_softc *sc);
 void ath_rx_node_init(struct ath_softc *sc, struct ath_node *an);
 void ath_rx_node_free(struct ath_softc *sc, struct ath_node *an);
 void ath_rx_node_cleanup(struct ath_softc *sc, struct ath_node *an);
+void ath_rx_node_detach(struct ath_softc *sc, struct ath_node *an);
 void ath_handle_rx_intr(struct ath_softc *sc);
+/*
+ * An rx buffer whose frame went up the stack as a clone. It stays
+ * mapped and is reused for the ring once the stack drops the clone.
+ */
+struct ath_rxlent {
+	struct sk_buff *skb;
+	dma_addr_t pa;
+	u_int16_t len;		/* bytes the cpu may have touched */
+};
+
+/* A received frame waiting in the rx tasklet to be handed up */
+struct ath_rx_pending {
+	struct sk_buff *skb;
+	struct ath_node *an;	/* resolved from the TA at delivery */
+	struct ath_recv_status status;
+	u_int16_t keyix;
+};
+
 int ath_rx_init(struct ath_softc *sc, int nbufs);
 void ath_rx_cleanup(struct ath_softc *sc);
-int ath_rx_tasklet(struct ath_softc *sc, int flush);
+int ath_rx_tasklet(struct ath_softc *sc, int flush, int budget);
 int ath_rx_input(struct ath_softc *sc,
 		 struct ath_node *node,
 		 int is_ampdu,
 		 struct sk_buff *skb,
 		 struct ath_recv_status *rx_status,
 		 enum ATH_RX_TYPE *status);
-int ath__rx_indicate(struct ath_softc *sc,
-		    struct sk_buff *skb,
-		    struct ath_recv_status *status,
-		    u_int16_t keyix);
+void ath__rx_indicate(struct ath_softc *sc,
+		      struct ath_rx_pending *rxp,
+		      int n);
 int ath_rx_subframe(struct ath_node *an, struct sk_buff *skb,
 		    struct ath_recv_status *status);
 
@@ -484,15 +611,14 @@ int ath_rx_subframe(struct ath_node *an, struct sk_buff *skb,
 
 #define ATH_FRAG_PER_MSDU       1
 #define ATH_TXBUF               (512/ATH_FRAG_PER_MSDU)
+/* upper bound on free tx buffers cached per cpu */
+#define ATH_TXBUF_CACHE_MAX     32
 /* max number of transmit attempts (tries) */
 #define ATH_TXMAXTRY            13
 /* max number of 11n transmit attempts (tries) */
 #define ATH_11N_TXMAXTRY        10
 /* max number of tries for management and control frames */
 #define ATH_MGT_TXMAXTRY        4
-#define WME_BA_BMP_SIZE         64
-#define WME_MAX_BA              WME_BA_BMP_SIZE
-#define ATH_TID_MAX_BUFS        (2 * WME_MAX_BA)
 #define TID_TO_WME_AC(_tid)				\
 	((((_tid) == 0) || ((_tid) == 3)) ? WME_AC_BE :	\
 	 (((_tid) == 1) || ((_tid) == 2)) ? WME_AC_BK :	\
@@ -507,6 +633,15 @@ int ath_rx_subframe(struct ath_node *an, struct sk_buff *skb,
 #define WME_AC_VO               3 /* voice */
 #define WME_NUM_AC              4
 
+/* per-cpu cache in front of the shared free tx buffer list */
+struct ath_txbuf_cache {
+	spinlock_t lock;	/* vs. other cpus stealing from it */
+	struct list_head free;
+	int count;
+	u_int64_t hits;		/* gets served from this cache */
+	u_int64_t steals;	/* refills from the pool or other caches */
+};
+
 enum ATH_SM_PWRSAV{
 	ATH_SM_ENABLE,
 	ATH_SM_PWRSAV_STATIC,
@@ -544,6 +679,14 @@ struct ath_txq {
 				* that determines whether lastdsWithCTS has
 				* been DMA'ed or not */
 	struct list_head	axq_acq;
+	/* doorbell batching, see ath_txq_batch_begin() */
+	u_int			axq_batch;	/* batch nesting depth */
+	u_int			axq_kickframes;	/* frames linked since the
+						last doorbell */
+	struct ath_buf		*axq_txdpbuf;	/* TXDP to load at the
+						next doorbell */
+	struct list_head	axq_held;	/* unsent frames kept over an
+						off-channel visit */
 };
 
 /* per TID aggregate tx state for a destination */
@@ -566,6 +709,9 @@ struct ath_atx_tid {
 	u_int32_t               addba_exchangecomplete:1; /* ADDBA state */
 	int32_t                 addba_exchangeinprogress;
 	int                     addba_exchangeattempts;
+	int                     aggr_max;   /* subframe limit */
+	int                     aggr_per;   /* averaged subframe error
+						rate, 1/256 units */
 };
 
 /* per access-category aggregate tx state for a destination */
@@ -575,6 +721,8 @@ struct ath_atx_ac {
 					with this AC */
 	struct list_head	list;   /* round-robin txq entry */
 	struct list_head	tid_q;      /* queue of TIDs with buffers */
+	int32_t                 airtime_deficit; /* usec left this round */
+	u_int64_t               airtime_used; /* usec charged, total */
 };
 
 /* per dest tx state */
@@ -633,12 +781,33 @@ struct ath_tx_stat {
 	u_int32_t airtime;	/* time on air per final tx rate */
 };
 
+#define ATH_HT_MCS_MAX          16
+/* mpdu density in usec is 0 or a power of two up to 16 */
+#define ATH_MPDUDENSITY_NUM     6
+#define ATH_MPDUDENSITY_IDX(_usec) ffs(_usec)
+
+/* HT airtime constants for one MCS, built by ath_tx_rate_setup() */
+struct ath_ht_rate_dur {
+	u_int32_t symrecip[2];	/* 2^32 / bits per symbol, by width */
+	u_int16_t symbits[2];	/* bits per symbol, by width */
+	u_int16_t preamble;	/* training and signal fields, usec */
+	u_int16_t minlen[ATH_MPDUDENSITY_NUM][2][2]; /* bytes spanning the
+				mpdu density, by density, width, half gi */
+};
+
+/* symbols needed for _nbits, exact for any frame the h/w can send */
+#define ATH_HT_NSYMBOLS(_hd, _w, _nbits)				\
+	((u_int32_t) (((u_int64_t) ((_nbits) + (_hd)->symbits[_w] - 1) * \
+		       (_hd)->symrecip[_w]) >> 32))
+
 struct ath_txq *ath_txq_setup(struct ath_softc *sc, int qtype, int subtype);
 void ath_tx_cleanupq(struct ath_softc *sc, struct ath_txq *txq);
 int ath_tx_setup(struct ath_softc *sc, int haltype);
 void ath_draintxq(struct ath_softc *sc, enum hal_bool retry_tx);
 void ath_tx_draintxq(struct ath_softc *sc,
 	struct ath_txq *txq, enum hal_bool retry_tx);
+enum hal_bool ath_tx_hold(struct ath_softc *sc);
+void ath_tx_unhold(struct ath_softc *sc, struct hal_channel *hchan);
 void ath_tx_node_init(struct ath_softc *sc, struct ath_node *an);
 void ath_tx_node_cleanup(struct ath_softc *sc,
 	struct ath_node *an, bool bh_flag);
@@ -664,6 +833,16 @@ void ath_tx_complete(struct ath_softc *sc, struct sk_buff *skb,
 #define ATH_NODE_CLEAN          0x1
 /* indicates the node is 80211 power save */
 #define ATH_NODE_PWRSAVE        0x2
+/* indicates small MSDUs to the node are packed into A-MSDUs */
+#define ATH_NODE_AMSDU          0x4
+/* indicates the node's tids are paused for an off-channel visit */
+#define ATH_NODE_TXHOLD         0x8
+/* buckets in the node table, power of 2 */
+#define ATH_NODE_HASHSIZE       32
+/* hash on the low mac bytes, these are the ones that vary between stations */
+#define ATH_NODE_HASH(_addr)						\
+	(((_addr)[ETH_ALEN - 1] ^ (_addr)[ETH_ALEN - 2]) &		\
+	 (ATH_NODE_HASHSIZE - 1))
 
 #define ADDBA_TIMEOUT              200 /* 200 milliseconds */
 #define ADDBA_EXCHANGE_ATTEMPTS    10
@@ -674,6 +853,21 @@ void ath_tx_complete(struct ath_softc *sc, struct sk_buff *skb,
 /* minimum h/w qdepth to be sustained to maximize aggregation */
 #define ATH_AGGR_MIN_QDEPTH        2
 #define ATH_AMPDU_SUBFRAME_DEFAULT 32
+/* an MPDU inside an A-MPDU may not be longer than this */
+#define ATH_AMPDU_MPDU_MAX         4095
+/* A-MSDU: largest MSDU worth packing, subframe header, size limits */
+#define ATH_AMSDU_MSDU_MAX         512
+#define ATH_AMSDU_SUBHDR_LEN       14
+#define ATH_AMSDU_LIMIT_DEFAULT    3839
+#define ATH_AMSDU_LIMIT_MAX        7935
+/* A-MSDU present bit in the first QoS control octet */
+#define ATH_QOS_AMSDU_PRESENT      0x80
+/* adaptive aggregate sizing: PER thresholds in 1/256 and lower limit */
+#define ATH_AGGR_PER_HIGH          64  /* 25%, halve the aggregate */
+#define ATH_AGGR_PER_LOW           26  /* 10%, grow by one subframe */
+#define ATH_AGGR_MIN_SUBFRAMES     2
+/* airtime granted to a node/ac per deficit round robin turn, usec */
+#define ATH_AIRTIME_QUANTUM        300
 #define IEEE80211_SEQ_SEQ_SHIFT    4
 #define IEEE80211_SEQ_MAX          4096
 #define IEEE80211_MIN_AMPDU_BUF    0x8
@@ -732,6 +926,8 @@ struct ath_node_aggr {
 /* driver-specific node state */
 struct ath_node {
 	struct list_head	list;
+	struct hlist_node	an_hash;	/* sc_nodehash chain */
+	struct rcu_head		an_rcu;		/* deferred free */
 	struct ath_softc    	*an_sc; 		/* back pointer */
 	atomic_t		an_refcnt;
 	struct ath_chainmask_sel an_chainmask_sel;
@@ -771,6 +967,8 @@ void ath_node_detach(struct ath_softc *sc, struct ath_node *an, bool bh_flag);
 struct ath_node *ath_node_get(struct ath_softc *sc, u_int8_t addr[ETH_ALEN]);
 void ath_node_put(struct ath_softc *sc, struct ath_node *an, bool bh_flag);
 struct ath_node *ath_node_find(struct ath_softc *sc, u_int8_t *addr);
+struct ath_node *ath_node_tx_get(struct ath_softc *sc, int if_id,
+				 u_int8_t *addr);
 
 /*******************/
 /* Beacon Handling */
@@ -876,6 +1074,8 @@ struct ath_vap {
 						transmit queue */
 	struct ath_vap_config           av_config;  /* vap configuration
 					parameters from 802.11 protocol layer*/
+	struct ath_node                 *av_txnode; /* last tx destination,
+						rcu */
 };
 
 int ath_vap_attach(struct ath_softc *sc,
@@ -979,6 +1179,34 @@ void ath_setdefantenna(void *sc, u_int antenna);
 /* This was not my interrupt, for shared IRQ's */
 #define ATH_ISR_NOTMINE         0x0002
 
+/* interrupt coalescing defaults and the load sampling period */
+#define ATH_INTR_TXFRAMES       8
+#define ATH_INTR_RXUSECS        250
+#define ATH_INTR_HIRATE         4000    /* frames/sec */
+#define ATH_INTR_WINDOW         (HZ / 10)
+
+/* calibration timer periods, ms */
+#define ATH_SHORT_CALINTERVAL   100     /* periodic cals in progress */
+#define ATH_LONG_CALINTERVAL    30000   /* noise floor */
+#define ATH_RESTART_CALINTERVAL 1200000 /* redo completed cals */
+
+enum ath_intr_mode {
+	ATH_INTR_LOWLAT,        /* interrupt per frame */
+	ATH_INTR_BULK,          /* coalesce tx and rx completions */
+};
+
+struct ath_intr_coalesce {
+	enum ath_intr_mode mode;
+	unsigned long window;   /* jiffies at start of sample window */
+	u_int32_t wintr;        /* interrupts in this window */
+	u_int32_t wframes;      /* rx + tx frames in this window */
+	u_int32_t intr_rate;    /* per second, last window */
+	u_int32_t frame_rate;
+	u_int64_t intr;         /* totals since load/clear */
+	u_int64_t frames;
+	u_int32_t switches;     /* mode changes */
+};
+
 #define RSSI_LPF_THRESHOLD         -20
 #define ATH_RSSI_EP_MULTIPLIER     (1<<7)  /* pow2 to optimize out * and / */
 #define ATH_RATE_DUMMY_MARKER      0
@@ -1024,6 +1252,7 @@ enum RATE_TYPE {
 struct ath_ht_info {
 	enum hal_ht_macmode tx_chan_width;
 	u_int16_t maxampdu;
+	u_int16_t maxamsdu;
 	u_int8_t mpdudensity;
 	u_int8_t ext_chan_offset;
 };
@@ -1040,6 +1269,7 @@ struct ath_softc {
 	struct ath_hal          *sc_ah;     /* HAL Instance */
 	struct ath_rate_softc    *sc_rc;     /* tx rate control support */
 	u_int32_t               sc_intrstatus; /* HAL_STATUS */
+	struct ath_intr_coalesce sc_intrcoal;  /* interrupt coalescing */
 	enum hal_opmode         sc_opmode;  /* current operating mode */
 
 	/* Properties, Config */
@@ -1054,6 +1284,7 @@ struct ath_softc {
 		sc_hasbmask            : 1, /* bssid mask support */
 		sc_hastsfadd           : 1, /* tsf adjust support */
 		sc_scanning            : 1, /* scanning active */
+		sc_txhold              : 1, /* tx held for off-channel visit */
 		sc_nostabeacons        : 1, /* no beacons for station */
 		sc_hasclrkey           : 1, /* CLR key supported */
 		sc_stagbeacons         : 1, /* use staggered beacons */
@@ -1095,6 +1326,8 @@ struct ath_softc {
 	int                     sc_bslot[ATH_BCBUF];/* beacon xmit slots */
 	struct hal_node_stats   sc_halstats;    /* station-mode rssi stats */
 	struct list_head        node_list;
+	struct hlist_head       sc_nodehash[ATH_NODE_HASHSIZE]; /* nodes
+						by mac address, rcu */
 	struct ath_ht_info      sc_ht_info;
 	int16_t                 sc_noise_floor; /* signal noise floor in dBm */
 	enum hal_ht_extprotspacing   sc_ht_extprotspacing;
@@ -1126,14 +1359,35 @@ struct ath_softc {
 
 	/* RX */
 	struct list_head	sc_rxbuf;       /* receive buffer */
+	struct ath_buf          *sc_rxring;     /* rx buffers in ring order */
+	u_int                   sc_rxnbuf;      /* # of buffers in the ring */
+	u_int                   sc_rxhead;      /* next buffer to complete */
+	struct ath_buf          *sc_rxheld;     /* holding descriptor */
+	struct ath_rx_pending   sc_rxpend[ATH_RX_BATCH]; /* frames to
+						indicate at end of batch */
+	int                     sc_nrxpend;
+	struct ath_rxlent       sc_rxlent[ATH_RX_RECYCLE]; /* buffers
+						out with the stack, oldest
+						first */
+	int                     sc_rxlenthead;
+	int                     sc_nrxlent;
 	struct ath_descdma      sc_rxdma;       /* RX descriptors */
 	int                     sc_rxbufsize;   /* rx size based on mtu */
 	u_int32_t               *sc_rxlink;     /* link ptr in last RX desc */
 	u_int32_t               sc_rxflush;     /* rx flush in progress */
+	u_int32_t               sc_rxpoll;      /* rx budget ran out, poll
+						again with rx intr masked */
+	struct list_head        sc_rxreorder;   /* tids holding subframes,
+						by release time */
+	spinlock_t              sc_rxreorder_lock;
+	struct timer_list       sc_rxreorder_timer; /* release of list head */
 	u_int64_t               sc_lastrx;      /* tsf of last rx'd frame */
 
 	/* TX */
 	struct list_head	sc_txbuf;       /* transmit buffer */
+	struct ath_txbuf_cache  *sc_txbufcache; /* per-cpu free txbufs */
+	int                     sc_txbufcache_max;   /* spill above this */
+	int                     sc_txbufcache_batch; /* refill/spill unit */
 	struct ath_txq          sc_txq[HAL_NUM_TX_QUEUES];
 	struct ath_descdma      sc_txdma;       /* TX descriptors */
 	u_int                   sc_txqsetup;    /* h/w queues setup */
@@ -1156,6 +1410,7 @@ struct ath_softc {
 	struct ieee80211_rate          rates[IEEE80211_NUM_BANDS][ATH_RATE_MAX];
 	const struct hal_rate_table    *sc_rates[WIRELESS_MODE_MAX];
 	const struct hal_rate_table    *sc_currates;   /* current rate table */
+	struct ath_ht_rate_dur         sc_htdur[ATH_HT_MCS_MAX]; /* per MCS */
 	u_int8_t                       sc_rixmap[256]; /* IEEE to h/w
 						rate table ix */
 	u_int8_t                       sc_minrateix;   /* min h/w rate index */
@@ -1169,6 +1424,13 @@ struct ath_softc {
 	struct ieee80211_channel channels[IEEE80211_NUM_BANDS][ATH_CHAN_MAX];
 	struct ieee80211_supported_band sbands[IEEE80211_NUM_BANDS];
 	struct hal_channel              sc_curchan; /* current h/w channel */
+	struct hal_channel              sc_txholdchan; /* channel held tx
+							  frames belong to */
+
+	/* Calibration */
+	struct timer_list       sc_cal_timer;   /* steps ath9k_hw_calibrate */
+	unsigned long           sc_longcal;     /* jiffies, next NF cal */
+	unsigned long           sc_restartcal;  /* jiffies, redo cals */
 
 	/* Locks */
 	spinlock_t              sc_rxflushlock; /* lock of RX flush */
@@ -1176,6 +1438,10 @@ struct ath_softc {
 	spinlock_t              sc_txbuflock;   /* txbuf lock */
 	spinlock_t              sc_resetlock;
 	spinlock_t              node_lock;
+
+#ifdef CONFIG_ATH9K_DEBUG
+	struct ath9k_debug      sc_dbg;         /* debugfs state */
+#endif
 };
 
 int ath_init(u_int16_t devid, struct ath_softc *sc);
@@ -1199,6 +1465,266 @@ void ath_setup_rate(struct ath_softc *sc,
 		    enum RATE_TYPE type,
 		    const struct hal_rate_table *rt);
 
+/*********/
+/* Debug */
+/*********/
+
+#ifdef CONFIG_ATH9K_DEBUG
+
+int ath9k_debug_create_root(void);
+void ath9k_debug_remove_root(void);
+int ath9k_init_debug(struct ath_softc *sc);
+void ath9k_exit_debug(struct ath_softc *sc);
+void ath9k_debug_txlat(struct ath_softc *sc, struct ath_buf *bf);
+
+static inline void ath9k_debug_rx(struct ath_softc *sc, int frames,
+				  u_int32_t bytes, cycles_t cycles)
+{
+	sc->sc_dbg.rx.frames += frames;
+	sc->sc_dbg.rx.bytes += bytes;
+	sc->sc_dbg.rx.batches++;
+	sc->sc_dbg.rx.cycles += cycles;
+}
+
+static inline void ath9k_debug_rxpoll(struct ath_softc *sc, int exhausted,
+				      cycles_t cycles)
+{
+	sc->sc_dbg.rx.polls++;
+	sc->sc_dbg.rx.exhausted += exhausted;
+	sc->sc_dbg.rx.poll_cycles += cycles;
+}
+
+static inline void ath9k_debug_rxbuf(struct ath_softc *sc, int recycled)
+{
+	if (recycled)
+		sc->sc_dbg.rx.recycled++;
+	else
+		sc->sc_dbg.rx.allocs++;
+}
+
+static inline void ath9k_debug_rxcopy(struct ath_softc *sc, u_int32_t len)
+{
+	sc->sc_dbg.rx.copied++;
+	sc->sc_dbg.rx.copied_bytes += len;
+}
+
+static inline void ath9k_debug_txsg(struct ath_softc *sc, int nsegs,
+				    int linearized)
+{
+	if (linearized) {
+		sc->sc_dbg.tx.linearized++;
+		return;
+	}
+	sc->sc_dbg.tx.sg_frames++;
+	sc->sc_dbg.tx.sg_segs += nsegs;
+}
+
+static inline cycles_t ath9k_debug_cycles(void)
+{
+	return get_cycles();
+}
+
+static inline void ath9k_debug_txnode(struct ath_softc *sc, int cached,
+				      cycles_t cycles)
+{
+	sc->sc_dbg.tx.node_lookups++;
+	if (cached)
+		sc->sc_dbg.tx.node_cached++;
+	sc->sc_dbg.tx.node_cycles += cycles;
+}
+
+static inline void ath9k_debug_aggr(struct ath_softc *sc, int nframes,
+				    cycles_t cycles)
+{
+	sc->sc_dbg.tx.aggr_forms++;
+	sc->sc_dbg.tx.aggr_subframes += nframes;
+	sc->sc_dbg.tx.aggr_cycles += cycles;
+}
+
+static inline void ath9k_debug_txkick(struct ath_softc *sc, int nframes,
+				      int nwrites)
+{
+	sc->sc_dbg.tx.kicks++;
+	sc->sc_dbg.tx.kick_frames += nframes;
+	sc->sc_dbg.tx.kick_mmio += nwrites;
+}
+
+static inline void ath9k_debug_txhold(struct ath_softc *sc, int nunits)
+{
+	sc->sc_dbg.tx.hold_visits++;
+	sc->sc_dbg.tx.hold_units += nunits;
+}
+
+static inline void ath9k_debug_txunhold(struct ath_softc *sc, int nunits,
+					enum hal_bool requeue)
+{
+	if (requeue)
+		sc->sc_dbg.tx.hold_requeued += nunits;
+	else
+		sc->sc_dbg.tx.hold_dropped += nunits;
+}
+
+static inline void ath9k_debug_amsdu(struct ath_softc *sc, int newmpdu)
+{
+	if (newmpdu) {
+		sc->sc_dbg.tx.amsdu_mpdus++;
+		sc->sc_dbg.tx.amsdu_msdus++;
+	}
+	sc->sc_dbg.tx.amsdu_msdus++;
+}
+
+static inline u_int32_t ath_txlat_now(void)
+{
+	return (u_int32_t) ktime_to_us(ktime_get());
+}
+
+static inline void ath_txlat_stamp(struct ath_buf *bf, int which)
+{
+	bf->bf_txlat[which] = ath_txlat_now();
+}
+
+static inline void ath9k_debug_rxhold_stamp(struct ath_rxbuf *rxbuf)
+{
+	rxbuf->rx_held = ath_txlat_now();
+}
+
+static inline void ath9k_debug_rxhold(struct ath_softc *sc,
+				      struct ath_rxbuf *rxbuf)
+{
+	int n = fls(ath_txlat_now() - rxbuf->rx_held);
+
+	sc->sc_dbg.rx.hold[min(n, ATH_RXHOLD_NBUCKETS - 1)]++;
+}
+
+static inline void ath9k_debug_rxtimeout(struct ath_softc *sc)
+{
+	sc->sc_dbg.rx.reorder_timeouts++;
+}
+
+static inline void ath9k_debug_rxrun(struct ath_softc *sc, int frames)
+{
+	sc->sc_dbg.rx.reorder_runs++;
+	sc->sc_dbg.rx.reorder_frames += frames;
+}
+
+/* Stamp every frame on a chain of ath_buf with the same time */
+static inline void ath_txlat_stamp_list(struct list_head *head, int which)
+{
+	u_int32_t now = ath_txlat_now();
+	struct ath_buf *bf;
+
+	list_for_each_entry(bf, head, list)
+		bf->bf_txlat[which] = now;
+}
+
+#else
+
+static inline int ath9k_debug_create_root(void)
+{
+	return 0;
+}
+
+static inline void ath9k_debug_remove_root(void)
+{
+}
+
+static inline int ath9k_init_debug(struct ath_softc *sc)
+{
+	return 0;
+}
+
+static inline void ath9k_exit_debug(struct ath_softc *sc)
+{
+}
+
+static inline void ath9k_debug_txlat(struct ath_softc *sc,
+				     struct ath_buf *bf)
+{
+}
+
+static inline void ath9k_debug_rx(struct ath_softc *sc, int frames,
+				  u_int32_t bytes, cycles_t cycles)
+{
+}
+
+static inline void ath9k_debug_rxpoll(struct ath_softc *sc, int exhausted,
+				      cycles_t cycles)
+{
+}
+
+static inline void ath9k_debug_rxbuf(struct ath_softc *sc, int recycled)
+{
+}
+
+static inline void ath9k_debug_rxcopy(struct ath_softc *sc, u_int32_t len)
+{
+}
+
+static inline void ath9k_debug_txsg(struct ath_softc *sc, int nsegs,
+				    int linearized)
+{
+}
+
+static inline cycles_t ath9k_debug_cycles(void)
+{
+	return 0;
+}
+
+static inline void ath9k_debug_txnode(struct ath_softc *sc, int cached,
+				      cycles_t cycles)
+{
+}
+
+static inline void ath9k_debug_aggr(struct ath_softc *sc, int nframes,
+				    cycles_t cycles)
+{
+}
+
+static inline void ath9k_debug_txkick(struct ath_softc *sc, int nframes,
+				      int nwrites)
+{
+}
+
+static inline void ath9k_debug_txhold(struct ath_softc *sc, int nunits)
+{
+}
+
+static inline void ath9k_debug_txunhold(struct ath_softc *sc, int nunits,
+					enum hal_bool requeue)
+{
+}
+
+static inline void ath9k_debug_amsdu(struct ath_softc *sc, int newmpdu)
+{
+}
+
+static inline void ath_txlat_stamp(struct ath_buf *bf, int which)
+{
+}
+
+static inline void ath9k_debug_rxhold_stamp(struct ath_rxbuf *rxbuf)
+{
+}
+
+static inline void ath9k_debug_rxhold(struct ath_softc *sc,
+				      struct ath_rxbuf *rxbuf)
+{
+}
+
+static inline void ath9k_debug_rxtimeout(struct ath_softc *sc)
+{
+}
+
+static inline void ath9k_debug_rxrun(struct ath_softc *sc, int frames)
+{
+}
+
+static inline void ath_txlat_stamp_list(struct list_head *head, int which)
+{
+}
+
+#endif /* CONFIG_ATH9K_DEBUG */
+
 /*********************/
 /* Utility Functions */
 /*********************/
@@ -0,0 +1,991 @@
+/*
+ * Copyright (c) 2008 Atheros Communications Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * debugfs statistics.
+ *
+ * Every data frame carries a timestamp for each point it passes on the
+ * way to the hardware (see enum ath_txlat_stamp). On completion the
+ * differences are folded into log2 histograms, one set per TID, kept
+ * per cpu so the completion path never takes a lock or bounces a
+ * cache line. Readers sum the per-cpu copies.
+ *
+ *   <debugfs>/ath9k/<phy>/txlat	read: histograms, write: clear
+ *   <debugfs>/ath9k/<phy>/airtime	per node/ac air time accounting
+ *   <debugfs>/ath9k/<phy>/aggr		per node/tid adapted aggregate size,
+ *					aggregate build cost, a-msdu packing
+ *   <debugfs>/ath9k/<phy>/rx		rx path cost, reorder hold times,
+ *					write: clear
+ *   <debugfs>/ath9k/<phy>/nodes	node table occupancy and lookup cost,
+ *					tx destination cache hits
+ *   <debugfs>/ath9k/<phy>/txbuf	per-cpu tx buffer cache hits/steals,
+ *					scatter-gather and linearized frames,
+ *					tx doorbell mmio writes per frame,
+ *					tx held over scan channel visits
+ *   <debugfs>/ath9k/<phy>/intr		interrupt coalescing, write: clear
+ *   <debugfs>/ath9k/<phy>/regs		register shadow: MMIO reads/writes
+ *					issued and saved, total and for the
+ *					last ath9k_hw_reset(), reset profile
+ *					hits, time per reset phase,
+ *					write: drop reset profiles
+ *   <debugfs>/ath9k/<phy>/cal		cold vs warm channel calibrations,
+ *					per-channel snapshot reuse, cal
+ *					step time, hw waits spun vs left
+ *					to the cal timer
+ *   <debugfs>/ath9k/<phy>/resettrace	last ath9k_hw_reset() calls, time
+ *					per phase of each
+ *   <debugfs>/ath9k/<phy>/sim		software chip model (sim=1 only):
+ *					config and counters, write:
+ *					"<key> <value>" to change the
+ *					config or "rx <len> <rate> [n]" to
+ *					receive n frames (n > 1: as one
+ *					aggregate)
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "core.h"
+
+/* Intervals derived from the stage timestamps */
+enum ath_txlat_stage {
+	ATH_TXLAT_TID,		/* ENQ -> DEQ: tid queue, BAW/pause stall */
+	ATH_TXLAT_AGGR,		/* DEQ -> HWQ: aggregate formation */
+	ATH_TXLAT_HW,		/* HWQ -> completion */
+	ATH_TXLAT_TOTAL,	/* ENQ -> completion */
+	ATH_TXLAT_NSTAGE
+};
+
+/* Bucket n counts intervals in [2^(n-1), 2^n) usec, the last is open */
+#define ATH_TXLAT_NBUCKET	24
+
+struct ath_txlat {
+	u_int32_t tl_hist[WME_NUM_TID][ATH_TXLAT_NSTAGE][ATH_TXLAT_NBUCKET];
+};
+
+static const char *ath_txlat_stage_name[ATH_TXLAT_NSTAGE] = {
+	"tid", "aggr", "hw", "total"
+};
+
+static const char *ath_ac_name[] = { "BE", "BK", "VI", "VO" };
+
+static struct dentry *ath9k_debugfs_root;
+
+static inline int ath_txlat_bucket(u_int32_t usec)
+{
+	int n = fls(usec);
+
+	return min(n, ATH_TXLAT_NBUCKET - 1);
+}
+
+void ath9k_debug_txlat(struct ath_softc *sc, struct ath_buf *bf)
+{
+	struct ath_txlat *tl;
+	u_int32_t *ts = bf->bf_txlat;
+	u_int32_t now = ath_txlat_now();
+	u_int32_t (*hist)[ATH_TXLAT_NBUCKET];
+
+	if (!sc->sc_dbg.txlat)
+		return;
+
+	/*
+	 * Frames drained from a tid queue never reached the hardware:
+	 * never stamped, or last stamped before a software retry took
+	 * them back. Only hardware completions are recorded.
+	 */
+	if (ts[ATH_TXLAT_HWQ] == 0 ||
+	    (int32_t) (ts[ATH_TXLAT_HWQ] - ts[ATH_TXLAT_DEQ]) < 0)
+		return;
+
+	tl = per_cpu_ptr(sc->sc_dbg.txlat, get_cpu());
+	hist = tl->tl_hist[bf->bf_tidno & (WME_NUM_TID - 1)];
+
+	hist[ATH_TXLAT_TID][ath_txlat_bucket(ts[ATH_TXLAT_DEQ] -
+					     ts[ATH_TXLAT_ENQ])]++;
+	hist[ATH_TXLAT_AGGR][ath_txlat_bucket(ts[ATH_TXLAT_HWQ] -
+					      ts[ATH_TXLAT_DEQ])]++;
+	hist[ATH_TXLAT_HW][ath_txlat_bucket(now - ts[ATH_TXLAT_HWQ])]++;
+	hist[ATH_TXLAT_TOTAL][ath_txlat_bucket(now - ts[ATH_TXLAT_ENQ])]++;
+
+	put_cpu();
+}
+
+/* Upper bound, in usec, of the bucket holding the given percentile */
+static u_int32_t ath_txlat_pct(const u_int32_t *hist, u_int32_t total,
+			       int pct)
+{
+	u_int32_t want = (u_int32_t) div_u64((u_int64_t) total * pct + 99,
+					     100);
+	u_int32_t seen = 0;
+	int i;
+
+	for (i = 0; i < ATH_TXLAT_NBUCKET; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			break;
+	}
+
+	return 1U << min(i, ATH_TXLAT_NBUCKET - 1);
+}
+
+static int ath_txlat_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct ath_txlat *sum;
+	int cpu, tidno, stage, i;
+
+	if (!sc->sc_dbg.txlat)
+		return 0;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct ath_txlat *tl = per_cpu_ptr(sc->sc_dbg.txlat, cpu);
+
+		for (tidno = 0; tidno < WME_NUM_TID; tidno++)
+			for (stage = 0; stage < ATH_TXLAT_NSTAGE; stage++)
+				for (i = 0; i < ATH_TXLAT_NBUCKET; i++)
+					sum->tl_hist[tidno][stage][i] +=
+						tl->tl_hist[tidno][stage][i];
+	}
+
+	seq_printf(m, "log2 usec buckets: [0] <1, [n] < 2^n, [%d] open\n",
+		   ATH_TXLAT_NBUCKET - 1);
+
+	for (tidno = 0; tidno < WME_NUM_TID; tidno++) {
+		int acno = TID_TO_WME_AC(tidno);
+		u_int32_t total = 0;
+
+		for (i = 0; i < ATH_TXLAT_NBUCKET; i++)
+			total += sum->tl_hist[tidno][ATH_TXLAT_TOTAL][i];
+		if (!total)
+			continue;
+
+		seq_printf(m, "\ntid %d ac %s txq %d: %u frames\n",
+			   tidno, ath_ac_name[acno],
+			   sc->sc_haltype2q[acno], total);
+
+		for (stage = 0; stage < ATH_TXLAT_NSTAGE; stage++) {
+			const u_int32_t *hist = sum->tl_hist[tidno][stage];
+
+			seq_printf(m, "  %-5s p50 <%u p99 <%u:",
+				   ath_txlat_stage_name[stage],
+				   ath_txlat_pct(hist, total, 50),
+				   ath_txlat_pct(hist, total, 99));
+			for (i = 0; i < ATH_TXLAT_NBUCKET; i++)
+				seq_printf(m, " %u", hist[i]);
+			seq_putc(m, '\n');
+		}
+	}
+
+	kfree(sum);
+	return 0;
+}
+
+static int ath_txlat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_txlat_show, inode->i_private);
+}
+
+static ssize_t ath_txlat_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct ath_softc *sc = m->private;
+	int cpu;
+
+	if (!sc->sc_dbg.txlat)
+		return count;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(sc->sc_dbg.txlat, cpu), 0,
+		       sizeof(struct ath_txlat));
+
+	return count;
+}
+
+static const struct file_operations fops_txlat = {
+	.open = ath_txlat_open,
+	.read = seq_read,
+	.write = ath_txlat_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_airtime_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct ath_node *an;
+	DECLARE_MAC_BUF(mac);
+	int acno;
+
+	seq_printf(m, "airtime fairness %s, quantum %d usec\n",
+		   sc->sc_config.airtime_fair ? "on" : "off",
+		   ATH_AIRTIME_QUANTUM);
+
+	if (!sc->sc_txaggr)
+		return 0;
+
+	spin_lock_bh(&sc->node_lock);
+	list_for_each_entry(an, &sc->node_list, list) {
+		seq_printf(m, "%s\n", print_mac(mac, an->an_addr));
+		for (acno = 0; acno < WME_NUM_AC; acno++) {
+			struct ath_atx_ac *ac = &an->an_aggr.tx.ac[acno];
+
+			seq_printf(m, "  %s used %llu deficit %d\n",
+				   ath_ac_name[acno],
+				   (unsigned long long) ac->airtime_used,
+				   ac->airtime_deficit);
+		}
+	}
+	spin_unlock_bh(&sc->node_lock);
+
+	return 0;
+}
+
+static int ath_airtime_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_airtime_show, inode->i_private);
+}
+
+static const struct file_operations fops_airtime = {
+	.open = ath_airtime_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_aggr_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct ath_node *an;
+	DECLARE_MAC_BUF(mac);
+	int tidno;
+
+	seq_printf(m, "adaptive aggregation %s, limit %d-%d subframes\n",
+		   sc->sc_config.aggr_adapt ? "on" : "off",
+		   ATH_AGGR_MIN_SUBFRAMES, ATH_AMPDU_SUBFRAME_DEFAULT);
+	seq_printf(m, "formed %llu subframes %llu cycles/subframe %llu\n",
+		   (unsigned long long) sc->sc_dbg.tx.aggr_forms,
+		   (unsigned long long) sc->sc_dbg.tx.aggr_subframes,
+		   sc->sc_dbg.tx.aggr_subframes ?
+		   (unsigned long long) div64_u64(sc->sc_dbg.tx.aggr_cycles,
+					sc->sc_dbg.tx.aggr_subframes) : 0ULL);
+	seq_printf(m, "a-msdu %s, limit %d bytes, mpdus %llu msdus %llu "
+		   "msdus/mpdu x100 %llu\n",
+		   sc->sc_config.tx_amsdu ? "on" : "off",
+		   sc->sc_ht_info.maxamsdu,
+		   (unsigned long long) sc->sc_dbg.tx.amsdu_mpdus,
+		   (unsigned long long) sc->sc_dbg.tx.amsdu_msdus,
+		   sc->sc_dbg.tx.amsdu_mpdus ?
+		   (unsigned long long)
+		   div64_u64(sc->sc_dbg.tx.amsdu_msdus * 100,
+			     sc->sc_dbg.tx.amsdu_mpdus) : 0ULL);
+
+	if (!sc->sc_txaggr)
+		return 0;
+
+	spin_lock_bh(&sc->node_lock);
+	list_for_each_entry(an, &sc->node_list, list) {
+		seq_printf(m, "%s%s\n", print_mac(mac, an->an_addr),
+			   (an->an_flags & ATH_NODE_AMSDU) ? " a-msdu" : "");
+		for (tidno = 0; tidno < WME_NUM_TID; tidno++) {
+			struct ath_atx_tid *tid = ATH_AN_2_TID(an, tidno);
+
+			if (!tid->addba_exchangecomplete)
+				continue;
+
+			seq_printf(m, "  tid %d subframes %d per %d%%\n",
+				   tidno, tid->aggr_max,
+				   (tid->aggr_per * 100) / 256);
+		}
+	}
+	spin_unlock_bh(&sc->node_lock);
+
+	return 0;
+}
+
+static int ath_aggr_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_aggr_show, inode->i_private);
+}
+
+static const struct file_operations fops_aggr = {
+	.open = ath_aggr_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_rx_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct ath_rx_stats rx = sc->sc_dbg.rx;
+	int i;
+
+	seq_printf(m, "frames %llu bytes %llu batches %llu\n",
+		   (unsigned long long) rx.frames,
+		   (unsigned long long) rx.bytes,
+		   (unsigned long long) rx.batches);
+
+	if (rx.frames)
+		seq_printf(m, "cycles/frame %llu bytes/frame %llu "
+			   "frames/batch %llu\n",
+			   (unsigned long long) div64_u64(rx.cycles, rx.frames),
+			   (unsigned long long) div64_u64(rx.bytes, rx.frames),
+			   (unsigned long long) div64_u64(rx.frames,
+							  rx.batches));
+	seq_printf(m, "polls %llu budget exhausted %llu\n",
+		   (unsigned long long) rx.polls,
+		   (unsigned long long) rx.exhausted);
+	seq_printf(m, "buffers alloc+map %llu recycled %llu\n",
+		   (unsigned long long) rx.allocs,
+		   (unsigned long long) rx.recycled);
+	seq_printf(m, "copybreak %u copied %llu bytes %llu\n",
+		   sc->sc_config.rx_copybreak,
+		   (unsigned long long) rx.copied,
+		   (unsigned long long) rx.copied_bytes);
+	if (rx.polls)
+		seq_printf(m, "cycles/poll %llu\n",
+			   (unsigned long long) div64_u64(rx.poll_cycles,
+							  rx.polls));
+
+	seq_printf(m, "reorder runs %llu frames %llu\n",
+		   (unsigned long long) rx.reorder_runs,
+		   (unsigned long long) rx.reorder_frames);
+	seq_printf(m, "reorder timeouts %llu, hold log2 usec:",
+		   (unsigned long long) rx.reorder_timeouts);
+	for (i = 0; i < ATH_RXHOLD_NBUCKETS; i++)
+		seq_printf(m, " %llu", (unsigned long long) rx.hold[i]);
+	seq_printf(m, "\n");
+	return 0;
+}
+
+static int ath_rx_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_rx_show, inode->i_private);
+}
+
+static ssize_t ath_rx_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct ath_softc *sc = m->private;
+
+	memset(&sc->sc_dbg.rx, 0, sizeof(sc->sc_dbg.rx));
+	return count;
+}
+
+static const struct file_operations fops_rx = {
+	.open = ath_rx_open,
+	.read = seq_read,
+	.write = ath_rx_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+/* lookups timed per node when reading the nodes file */
+#define ATH_NODE_BENCH_LOOPS	64
+
+/*
+ * Times ath_node_find() against every associated station, plus a miss,
+ * so the lookup cost can be compared as the station count grows.
+ */
+static int ath_nodes_show(struct seq_file *m, void *v)
+{
+	static const u8 miss[ETH_ALEN] = { 0x02, 0, 0, 0, 0, 0 };
+	struct ath_softc *sc = m->private;
+	struct ath_node *an;
+	struct hlist_node *pos;
+	u64 hit = 0, nhit = 0, nmiss;
+	cycles_t t;
+	int i, j, depth, maxdepth = 0, used = 0, nodes = 0;
+
+	rcu_read_lock();
+	for (i = 0; i < ATH_NODE_HASHSIZE; i++) {
+		depth = 0;
+		hlist_for_each_entry_rcu(an, pos, &sc->sc_nodehash[i],
+					 an_hash) {
+			depth++;
+			t = get_cycles();
+			for (j = 0; j < ATH_NODE_BENCH_LOOPS; j++)
+				ath_node_find(sc, an->an_addr);
+			hit += get_cycles() - t;
+			nhit += ATH_NODE_BENCH_LOOPS;
+		}
+		if (depth)
+			used++;
+		if (depth > maxdepth)
+			maxdepth = depth;
+		nodes += depth;
+	}
+
+	t = get_cycles();
+	for (j = 0; j < ATH_NODE_BENCH_LOOPS; j++)
+		ath_node_find(sc, (u8 *) miss);
+	nmiss = get_cycles() - t;
+	rcu_read_unlock();
+
+	seq_printf(m, "nodes %d buckets %d/%d longest chain %d\n",
+		   nodes, used, ATH_NODE_HASHSIZE, maxdepth);
+	seq_printf(m, "cycles/lookup hit %llu miss %llu\n",
+		   nhit ? (unsigned long long) div64_u64(hit, nhit) : 0ULL,
+		   (unsigned long long) div64_u64(nmiss,
+						  ATH_NODE_BENCH_LOOPS));
+	seq_printf(m, "tx lookups %llu cached %llu cycles/lookup %llu\n",
+		   (unsigned long long) sc->sc_dbg.tx.node_lookups,
+		   (unsigned long long) sc->sc_dbg.tx.node_cached,
+		   sc->sc_dbg.tx.node_lookups ?
+		   (unsigned long long) div64_u64(sc->sc_dbg.tx.node_cycles,
+					sc->sc_dbg.tx.node_lookups) : 0ULL);
+	return 0;
+}
+
+static int ath_nodes_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_nodes_show, inode->i_private);
+}
+
+static const struct file_operations fops_nodes = {
+	.open = ath_nodes_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_txbuf_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct ath_txbuf_cache *tc;
+	int cpu;
+
+	if (sc->sc_txbufcache == NULL)
+		return 0;
+
+	seq_printf(m, "cache max %d batch %d\n",
+		   sc->sc_txbufcache_max, sc->sc_txbufcache_batch);
+	for_each_online_cpu(cpu) {
+		tc = per_cpu_ptr(sc->sc_txbufcache, cpu);
+		seq_printf(m, "cpu%d cached %d hits %llu steals %llu\n",
+			   cpu, tc->count,
+			   (unsigned long long) tc->hits,
+			   (unsigned long long) tc->steals);
+	}
+	seq_printf(m, "sg %s frames %llu segs %llu linearized %llu\n",
+		   sc->sc_config.tx_linearize ? "off" : "on",
+		   (unsigned long long) sc->sc_dbg.tx.sg_frames,
+		   (unsigned long long) sc->sc_dbg.tx.sg_segs,
+		   (unsigned long long) sc->sc_dbg.tx.linearized);
+	seq_printf(m, "doorbells %llu frames %llu mmio writes %llu "
+		   "per 100 frames %llu\n",
+		   (unsigned long long) sc->sc_dbg.tx.kicks,
+		   (unsigned long long) sc->sc_dbg.tx.kick_frames,
+		   (unsigned long long) sc->sc_dbg.tx.kick_mmio,
+		   sc->sc_dbg.tx.kick_frames ?
+		   (unsigned long long)
+		   div64_u64(sc->sc_dbg.tx.kick_mmio * 100,
+			     sc->sc_dbg.tx.kick_frames) : 0ULL);
+	seq_printf(m, "scan hold %s visits %llu held %llu requeued %llu "
+		   "dropped %llu%s\n",
+		   sc->sc_config.tx_scanhold ? "on" : "off",
+		   (unsigned long long) sc->sc_dbg.tx.hold_visits,
+		   (unsigned long long) sc->sc_dbg.tx.hold_units,
+		   (unsigned long long) sc->sc_dbg.tx.hold_requeued,
+		   (unsigned long long) sc->sc_dbg.tx.hold_dropped,
+		   sc->sc_txhold ? " (holding)" : "");
+	return 0;
+}
+
+static int ath_txbuf_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_txbuf_show, inode->i_private);
+}
+
+static const struct file_operations fops_txbuf = {
+	.open = ath_txbuf_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_intr_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct ath_intr_coalesce *ic = &sc->sc_intrcoal;
+
+	seq_printf(m, "coalescing %s, mode %s, switches %u\n",
+		   sc->sc_config.intr_coalesce ? "adaptive" : "off",
+		   ic->mode == ATH_INTR_BULK ? "bulk" : "low latency",
+		   ic->switches);
+	seq_printf(m, "tx frames/intr %u rx usecs %u above %u frames/s\n",
+		   sc->sc_config.intr_txframes, sc->sc_config.intr_rxusecs,
+		   sc->sc_config.intr_hirate);
+	seq_printf(m, "intr/s %u frames/s %u\n",
+		   ic->intr_rate, ic->frame_rate);
+	seq_printf(m, "intr %llu frames %llu\n",
+		   (unsigned long long) ic->intr,
+		   (unsigned long long) ic->frames);
+	if (ic->intr)
+		seq_printf(m, "frames/intr %llu\n",
+			   (unsigned long long) div64_u64(ic->frames,
+							  ic->intr));
+	return 0;
+}
+
+static int ath_intr_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_intr_show, inode->i_private);
+}
+
+static ssize_t ath_intr_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct ath_softc *sc = m->private;
+
+	sc->sc_intrcoal.intr = 0;
+	sc->sc_intrcoal.frames = 0;
+	sc->sc_intrcoal.switches = 0;
+	return count;
+}
+
+static const struct file_operations fops_intr = {
+	.open = ath_intr_open,
+	.read = seq_read,
+	.write = ath_intr_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static void ath_regs_print(struct seq_file *m, const char *what,
+			   const struct hal_reg_stats *rs)
+{
+	seq_printf(m, "%-6s reads %u saved %u writes %u saved %u "
+		   "buffered %u\n", what,
+		   rs->rs_reads, rs->rs_reads_saved,
+		   rs->rs_writes, rs->rs_writes_saved, rs->rs_buffered);
+}
+
+static const char *ath_reset_phase_names[HAL_RESET_PHASE_MAX] = {
+	"prep", "chip", "ini", "spur", "channel", "mac", "bb", "cal"
+};
+
+static int ath_regs_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct hal_reset_stats *rt = &sc->sc_ah->ah_resetstats;
+	struct hal_reg_stats total, reset;
+	struct hal_prof_stats ps;
+	int i;
+
+	ath9k_hw_shadow_getstats(sc->sc_ah, &total, &reset);
+	seq_printf(m, "resets %u\n", total.rs_resets);
+	ath_regs_print(m, "total", &total);
+	ath_regs_print(m, "reset", &reset);
+
+	ath9k_hw_profile_getstats(sc->sc_ah, &ps);
+	seq_printf(m, "profiles %u writes %u hits %u misses %u "
+		   "evicted %u dropped %u\n",
+		   ps.ps_profiles, ps.ps_writes, ps.ps_hits, ps.ps_misses,
+		   ps.ps_evicted, ps.ps_dropped);
+
+	seq_printf(m, "\nfull resets %u fast channel changes %u "
+		   "(last %u us) slow %u\n",
+		   rt->rt_resets, rt->rt_fastchan, rt->rt_fastchan_last,
+		   rt->rt_slow);
+	seq_printf(m, "txpower tables built during pll settle %u, "
+		   "settle time used %llu us\n", rt->rt_txpow_pre,
+		   (unsigned long long) rt->rt_overlap);
+	seq_printf(m, "%-8s %8s %8s %8s\n", "phase", "last", "max", "avg");
+	for (i = 0; i < HAL_RESET_PHASE_MAX; i++) {
+		seq_printf(m, "%-8s %8u %8u %8llu\n", ath_reset_phase_names[i],
+			   rt->rt_last[i], rt->rt_max[i],
+			   rt->rt_resets ? (unsigned long long)
+			   div64_u64(rt->rt_total[i], rt->rt_resets) : 0ULL);
+	}
+	return 0;
+}
+
+static int ath_regs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_regs_show, inode->i_private);
+}
+
+static ssize_t ath_regs_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct ath_softc *sc = m->private;
+
+	spin_lock_bh(&sc->sc_resetlock);
+	ath9k_hw_profile_flush(sc->sc_ah);
+	spin_unlock_bh(&sc->sc_resetlock);
+	return count;
+}
+
+static const struct file_operations fops_regs = {
+	.open = ath_regs_open,
+	.read = seq_read,
+	.write = ath_regs_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_resettrace_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct ath_hal *ah = sc->sc_ah;
+	struct hal_reset_trace *tr;
+	u_int32_t seq = ah->ah_resettrace_seq;
+	u_int32_t n;
+	int i;
+
+	seq_printf(m, "%6s %5s %8s %4s %3s %7s", "seq", "freq", "flags",
+		   "type", "st", "total");
+	for (i = 0; i < HAL_RESET_PHASE_MAX; i++)
+		seq_printf(m, " %7s", ath_reset_phase_names[i]);
+	seq_printf(m, "\n");
+
+	n = min_t(u_int32_t, seq, HAL_RESET_TRACE_LEN);
+	for (seq -= n - 1; n > 0; n--, seq++) {
+		tr = &ah->ah_resettrace[seq % HAL_RESET_TRACE_LEN];
+		seq_printf(m, "%6u %5u %8x %4s %3d %7u", tr->tr_seq,
+			   tr->tr_channel, tr->tr_channelFlags,
+			   tr->tr_fastchan ? "fast" : "full",
+			   tr->tr_status, tr->tr_total);
+		for (i = 0; i < HAL_RESET_PHASE_MAX; i++)
+			seq_printf(m, " %7u", tr->tr_phase[i]);
+		seq_printf(m, "\n");
+	}
+	return 0;
+}
+
+static int ath_resettrace_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_resettrace_show, inode->i_private);
+}
+
+static const struct file_operations fops_resettrace = {
+	.open = ath_resettrace_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_cal_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct hal_cal_stats *cs = &sc->sc_ah->ah_calstats;
+
+	seq_printf(m, "cold %u warm %u stale %u\n",
+		   cs->cs_cold, cs->cs_warm, cs->cs_stale);
+	seq_printf(m, "snapshots saved %u cals restored %u "
+		   "(max age %d s)\n", cs->cs_saved, cs->cs_restored,
+		   sc->sc_ah->ah_config.ath_hal_calSnapAge);
+
+	seq_printf(m, "\nsteps %u last %u us max %u us avg %llu us\n",
+		   cs->cs_steps, cs->cs_step_last, cs->cs_step_max,
+		   cs->cs_steps ? (unsigned long long)
+		   div64_u64(cs->cs_step_total, cs->cs_steps) : 0ULL);
+	seq_printf(m, "hw waits (%s): spun %llu us, deferred %u "
+		   "for %llu us not spun, timeouts %u\n",
+		   sc->sc_config.cal_async ? "async" : "sync",
+		   (unsigned long long) cs->cs_wait_spun, cs->cs_deferred,
+		   (unsigned long long) cs->cs_wait_async, cs->cs_timeouts);
+	return 0;
+}
+
+static int ath_cal_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_cal_show, inode->i_private);
+}
+
+static const struct file_operations fops_cal = {
+	.open = ath_cal_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+static int ath_sim_show(struct seq_file *m, void *v)
+{
+	struct ath_softc *sc = m->private;
+	struct hal_sim_config cfg;
+	struct hal_sim_stats ss;
+
+	if (!ath9k_hw_sim_active(sc->sc_ah)) {
+		seq_printf(m, "chip model not attached\n");
+		return 0;
+	}
+
+	ath9k_hw_sim_getconfig(sc->sc_ah, &cfg);
+	ath9k_hw_sim_getstats(sc->sc_ah, &ss);
+	seq_printf(m, "overhead %u loss %u ba_low 0x%08x ba_high 0x%08x "
+		   "rssi %d\n", cfg.sim_overhead, cfg.sim_loss,
+		   cfg.sim_ba_low, cfg.sim_ba_high, cfg.sim_rssi);
+	seq_printf(m, "\ntx ppdu %u mpdu %u lost %u xretry %u\n",
+		   ss.ss_txppdu, ss.ss_txmpdu, ss.ss_txlost, ss.ss_txxretry);
+	seq_printf(m, "rx frames %u dropped %u\n",
+		   ss.ss_rxframes, ss.ss_rxdrop);
+	seq_printf(m, "air time %llu us\n",
+		   (unsigned long long) ss.ss_airtime);
+	return 0;
+}
+
+static int ath_sim_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ath_sim_show, inode->i_private);
+}
+
+/*
+ * Inject n data frames of len bytes, from the BSSID to us, at the
+ * given hardware rate code. More than one frame is delivered as an
+ * aggregate, the way the hardware reports the subframes.
+ */
+static int ath_sim_rx(struct ath_softc *sc, u_int len, u_int rate, u_int n)
+{
+	struct ieee80211_hdr *hdr;
+	u_int8_t *frame;
+	u_int flags, i;
+	int error = 0;
+
+	if (len < sizeof(*hdr) + FCS_LEN || len > sc->sc_rxbufsize ||
+	    rate > 0xff || n == 0 || n > ATH_RXBUF)
+		return -EINVAL;
+
+	frame = kzalloc(len, GFP_KERNEL);
+	if (!frame)
+		return -ENOMEM;
+
+	hdr = (struct ieee80211_hdr *) frame;
+	hdr->frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA |
+					 IEEE80211_STYPE_DATA |
+					 IEEE80211_FCTL_FROMDS);
+	memcpy(hdr->addr1, sc->sc_myaddr, ETH_ALEN);
+	memcpy(hdr->addr2, sc->sc_curbssid, ETH_ALEN);
+	memcpy(hdr->addr3, sc->sc_curbssid, ETH_ALEN);
+
+	for (i = 0; i < n; i++) {
+		hdr->seq_ctrl = cpu_to_le16((i << 4) & IEEE80211_SCTL_SEQ);
+		flags = 0;
+		if (n > 1)
+			flags |= HAL_SIM_RX_AGGR;
+		if (i + 1 < n)
+			flags |= HAL_SIM_RX_MOREAGGR;
+		if (!ath9k_hw_sim_rxinject(sc->sc_ah, frame, len,
+					   (u_int8_t) rate, flags)) {
+			error = -EIO;
+			break;
+		}
+	}
+
+	kfree(frame);
+	return error;
+}
+
+static ssize_t ath_sim_write(struct file *file, const char __user *user_buf,
+			     size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct ath_softc *sc = m->private;
+	struct hal_sim_config cfg;
+	char buf[64], key[16];
+	u_int val, rate, n;
+	int nargs, error;
+
+	if (!ath9k_hw_sim_active(sc->sc_ah))
+		return -ENODEV;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	nargs = sscanf(buf, "%15s %i %i %i", key, &val, &rate, &n);
+	if (nargs < 2)
+		return -EINVAL;
+
+	if (strcmp(key, "rx") == 0) {
+		if (nargs < 3)
+			return -EINVAL;
+		error = ath_sim_rx(sc, val, rate, nargs > 3 ? n : 1);
+		return error ? error : count;
+	}
+
+	ath9k_hw_sim_getconfig(sc->sc_ah, &cfg);
+	if (strcmp(key, "overhead") == 0)
+		cfg.sim_overhead = val;
+	else if (strcmp(key, "loss") == 0 && val <= 1000)
+		cfg.sim_loss = val;
+	else if (strcmp(key, "ba_low") == 0)
+		cfg.sim_ba_low = val;
+	else if (strcmp(key, "ba_high") == 0)
+		cfg.sim_ba_high = val;
+	else if (strcmp(key, "rssi") == 0 && val <= 127)
+		cfg.sim_rssi = val;
+	else
+		return -EINVAL;
+	ath9k_hw_sim_setconfig(sc->sc_ah, &cfg);
+	return count;
+}
+
+static const struct file_operations fops_sim = {
+	.open = ath_sim_open,
+	.read = seq_read,
+	.write = ath_sim_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE
+};
+
+int ath9k_init_debug(struct ath_softc *sc)
+{
+	if (!ath9k_debugfs_root)
+		return -ENOENT;
+
+	sc->sc_dbg.txlat = alloc_percpu(struct ath_txlat);
+	if (!sc->sc_dbg.txlat)
+		goto err;
+
+	sc->sc_dbg.debugfs_phy = debugfs_create_dir(wiphy_name(sc->hw->wiphy),
+						    ath9k_debugfs_root);
+	if (!sc->sc_dbg.debugfs_phy)
+		goto err;
+
+	sc->sc_dbg.debugfs_txlat = debugfs_create_file("txlat",
+		S_IRUSR | S_IWUSR, sc->sc_dbg.debugfs_phy, sc, &fops_txlat);
+	if (!sc->sc_dbg.debugfs_txlat)
+		goto err;
+
+	sc->sc_dbg.debugfs_airtime = debugfs_create_file("airtime",
+		S_IRUSR, sc->sc_dbg.debugfs_phy, sc, &fops_airtime);
+	if (!sc->sc_dbg.debugfs_airtime)
+		goto err;
+
+	sc->sc_dbg.debugfs_aggr = debugfs_create_file("aggr",
+		S_IRUSR, sc->sc_dbg.debugfs_phy, sc, &fops_aggr);
+	if (!sc->sc_dbg.debugfs_aggr)
+		goto err;
+
+	sc->sc_dbg.debugfs_rx = debugfs_create_file("rx",
+		S_IRUSR | S_IWUSR, sc->sc_dbg.debugfs_phy, sc, &fops_rx);
+	if (!sc->sc_dbg.debugfs_rx)
+		goto err;
+
+	sc->sc_dbg.debugfs_nodes = debugfs_create_file("nodes",
+		S_IRUSR, sc->sc_dbg.debugfs_phy, sc, &fops_nodes);
+	if (!sc->sc_dbg.debugfs_nodes)
+		goto err;
+
+	sc->sc_dbg.debugfs_txbuf = debugfs_create_file("txbuf",
+		S_IRUSR, sc->sc_dbg.debugfs_phy, sc, &fops_txbuf);
+	if (!sc->sc_dbg.debugfs_txbuf)
+		goto err;
+
+	sc->sc_dbg.debugfs_intr = debugfs_create_file("intr",
+		S_IRUSR | S_IWUSR, sc->sc_dbg.debugfs_phy, sc, &fops_intr);
+	if (!sc->sc_dbg.debugfs_intr)
+		goto err;
+
+	sc->sc_dbg.debugfs_regs = debugfs_create_file("regs",
+		S_IRUSR | S_IWUSR, sc->sc_dbg.debugfs_phy, sc, &fops_regs);
+	if (!sc->sc_dbg.debugfs_regs)
+		goto err;
+
+	sc->sc_dbg.debugfs_cal = debugfs_create_file("cal",
+		S_IRUSR, sc->sc_dbg.debugfs_phy, sc, &fops_cal);
+	if (!sc->sc_dbg.debugfs_cal)
+		goto err;
+
+	sc->sc_dbg.debugfs_resettrace = debugfs_create_file("resettrace",
+		S_IRUSR, sc->sc_dbg.debugfs_phy, sc, &fops_resettrace);
+	if (!sc->sc_dbg.debugfs_resettrace)
+		goto err;
+
+	sc->sc_dbg.debugfs_sim = debugfs_create_file("sim",
+		S_IRUSR | S_IWUSR, sc->sc_dbg.debugfs_phy, sc, &fops_sim);
+	if (!sc->sc_dbg.debugfs_sim)
+		goto err;
+
+	return 0;
+err:
+	ath9k_exit_debug(sc);
+	return -ENOMEM;
+}
+
+void ath9k_exit_debug(struct ath_softc *sc)
+{
+	debugfs_remove(sc->sc_dbg.debugfs_sim);
+	debugfs_remove(sc->sc_dbg.debugfs_resettrace);
+	debugfs_remove(sc->sc_dbg.debugfs_cal);
+	debugfs_remove(sc->sc_dbg.debugfs_regs);
+	debugfs_remove(sc->sc_dbg.debugfs_intr);
+	debugfs_remove(sc->sc_dbg.debugfs_txbuf);
+	debugfs_remove(sc->sc_dbg.debugfs_nodes);
+	debugfs_remove(sc->sc_dbg.debugfs_rx);
+	debugfs_remove(sc->sc_dbg.debugfs_aggr);
+	debugfs_remove(sc->sc_dbg.debugfs_airtime);
+	debugfs_remove(sc->sc_dbg.debugfs_txlat);
+	debugfs_remove(sc->sc_dbg.debugfs_phy);
+	sc->sc_dbg.debugfs_sim = NULL;
+	sc->sc_dbg.debugfs_resettrace = NULL;
+	sc->sc_dbg.debugfs_cal = NULL;
+	sc->sc_dbg.debugfs_regs = NULL;
+	sc->sc_dbg.debugfs_intr = NULL;
+	sc->sc_dbg.debugfs_txbuf = NULL;
+	sc->sc_dbg.debugfs_nodes = NULL;
+	sc->sc_dbg.debugfs_rx = NULL;
+	sc->sc_dbg.debugfs_aggr = NULL;
+	sc->sc_dbg.debugfs_airtime = NULL;
+	sc->sc_dbg.debugfs_txlat = NULL;
+	sc->sc_dbg.debugfs_phy = NULL;
+
+	free_percpu(sc->sc_dbg.txlat);
+	sc->sc_dbg.txlat = NULL;
+}
+
+int ath9k_debug_create_root(void)
+{
+	ath9k_debugfs_root = debugfs_create_dir(KBUILD_MODNAME, NULL);
+	if (!ath9k_debugfs_root)
+		return -ENOENT;
+
+	return 0;
+}
+
+void ath9k_debug_remove_root(void)
+{
+	debugfs_remove(ath9k_debugfs_root);
+	ath9k_debugfs_root = NULL;
+}
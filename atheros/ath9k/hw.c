@@ -15,6 +15,8 @@
  */
 
 #include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
 
 #include "ath9k.h"
 #include "hw.h"
@@ -30,6 +32,9 @@ static void ath9k_hw_adc_gaincal_calibrate(struct ath_hal *ah,
 static void ath9k_hw_adc_dccal_collect(struct ath_hal *ah);
 static void ath9k_hw_adc_dccal_calibrate(struct ath_hal *ah,
 					 u_int8_t numChains);
+static void ath9k_hw_settle(struct ath_hal *ah, u_int32_t usecs);
+static void ath9k_hw_init_cal_done(struct ath_hal *ah,
+				   struct hal_channel_internal *ichan);
 
 static const u_int8_t CLOCK_RATE[] = { 40, 80, 22, 44, 88, 40 };
 static const int16_t NOISE_FLOOR[] = { -96, -93, -98, -96, -93, -96 };
@@ -249,6 +254,15 @@ static enum hal_bool ath9k_hw_wait(struct ath_hal *ah,
 	return AH_FALSE;
 }
 
+static inline u_int32_t ath9k_hw_usecs_since(ktime_t *mark)
+{
+	ktime_t now = ktime_get();
+	u_int32_t us = (u_int32_t) ktime_to_us(ktime_sub(now, *mark));
+
+	*mark = now;
+	return us;
+}
+
 static enum hal_bool ath9k_hw_eeprom_read(struct ath_hal *ah, u_int off,
 				   u_int16_t *data)
 {
@@ -368,6 +382,8 @@ static void ath9k_hw_set_defaults(struct ath_hal *ah)
 	}
 
 	ah->ah_config.ath_hal_intrMitigation = 0;
+	ah->ah_config.ath_hal_calSnapAge = 1200;
+	ah->ah_config.ath_hal_calAsync = 0;
 	ah->ah_config.ath_hal_debug = 0;
 }
 
@@ -1220,6 +1236,8 @@ static struct ath_hal_5416 *ath9k_hw_newstate(u_int16_t devid, void *sc,
 	memcpy(&ahp->ah_bssidmask, defbssidmask, ETH_ALEN);
 
 	ahp->ah_gBeaconRate = 0;
+	ahp->ah_rimtLast = 500;
+	ahp->ah_rimtFirst = 2000;
 
 	return ahp;
 }
@@ -1489,7 +1507,7 @@ static inline void ath9k_hw_init_pll(struct ath_hal *ah,
 	}
 	REG_WRITE(ah, (u_int16_t) (AR_RTC_PLL_CONTROL), pll);
 
-	udelay(RTC_PLL_SETTLE_DELAY);
+	ath9k_hw_settle(ah, RTC_PLL_SETTLE_DELAY);
 
 	REG_WRITE(ah, AR_RTC_SLEEP_CLK, AR_RTC_FORCE_DERIVED_CLK);
 }
@@ -1601,6 +1619,7 @@ static enum hal_bool ath9k_hw_set_reset(struct ath_hal *ah, int type)
 			 __func__);
 		return AH_FALSE;
 	}
+	ath9k_hw_shadow_invalidate(ah);
 
 	if (!AR_SREV_9100(ah))
 		REG_WRITE(ah, AR_RC, 0);
@@ -1629,6 +1648,7 @@ static inline enum hal_bool ath9k_hw_set_reset_power_on(struct ath_hal *ah)
 			 __func__);
 		return AH_FALSE;
 	}
+	ath9k_hw_shadow_invalidate(ah);
 
 	ath9k_hw_read_revisions(ah);
 
@@ -1877,11 +1897,10 @@ static void ath9k_hw_start_nfcal(struct ath_hal *ah)
 	OS_REG_SET_BIT(ah, AR_PHY_AGC_CONTROL, AR_PHY_AGC_CONTROL_NF);
 }
 
-static void
-ath9k_hw_loadnf(struct ath_hal *ah, struct hal_channel_internal *chan)
+static void ath9k_hw_write_cca(struct ath_hal *ah,
+			       struct hal_nfcal_hist *h)
 {
-	struct hal_nfcal_hist *h;
-	int i, j;
+	int i;
 	int32_t val;
 	const u_int32_t ar5416_cca_regs[6] = {
 		AR_PHY_CCA,
@@ -1898,42 +1917,81 @@ ath9k_hw_loadnf(struct ath_hal *ah, struct hal_channel_internal *chan)
 	else
 		chainmask = 0x3F;
 
-#ifdef ATH_NF_PER_CHAN
-	h = chan->nfCalHist;
-#else
-	h = ah->nfCalHist;
-#endif
-
 	for (i = 0; i < NUM_NF_READINGS; i++) {
 		if (chainmask & (1 << i)) {
 			val = REG_READ(ah, ar5416_cca_regs[i]);
 			val &= 0xFFFFFE00;
-			val |= (((u_int32_t) (h[i].privNF) << 1) & 0x1ff);
+			val |= (((u_int32_t) (h ? h[i].privNF : -50) << 1) &
+				0x1ff);
 			REG_WRITE(ah, ar5416_cca_regs[i], val);
 		}
 	}
+}
+
+/*
+ * Loading the NF history is split so that the wait for the baseband
+ * to take it can be left to ath9k_hw_cal_poll() rather than spun on.
+ */
+static void
+ath9k_hw_loadnf_start(struct ath_hal *ah, struct hal_channel_internal *chan)
+{
+	struct hal_nfcal_hist *h;
+
+#ifdef ATH_NF_PER_CHAN
+	h = chan->nfCalHist;
+#else
+	h = ah->nfCalHist;
+#endif
+
+	ath9k_hw_write_cca(ah, h);
 
 	OS_REG_CLR_BIT(ah, AR_PHY_AGC_CONTROL,
 		       AR_PHY_AGC_CONTROL_ENABLE_NF);
 	OS_REG_CLR_BIT(ah, AR_PHY_AGC_CONTROL,
 		       AR_PHY_AGC_CONTROL_NO_UPDATE_NF);
 	OS_REG_SET_BIT(ah, AR_PHY_AGC_CONTROL, AR_PHY_AGC_CONTROL_NF);
+}
+
+static void
+ath9k_hw_loadnf(struct ath_hal *ah, struct hal_channel_internal *chan)
+{
+	ktime_t mark = ktime_get();
+	int j;
 
-	for (j = 0; j < 1000; j++) {
+	ath9k_hw_loadnf_start(ah, chan);
+
+	for (j = 0; j < AH_NFLOAD_TIMEOUT / AH_TIME_QUANTUM; j++) {
 		if ((REG_READ(ah, AR_PHY_AGC_CONTROL) &
 		     AR_PHY_AGC_CONTROL_NF) == 0)
 			break;
-		udelay(10);
+		udelay(AH_TIME_QUANTUM);
 	}
 
-	for (i = 0; i < NUM_NF_READINGS; i++) {
-		if (chainmask & (1 << i)) {
-			val = REG_READ(ah, ar5416_cca_regs[i]);
-			val &= 0xFFFFFE00;
-			val |= (((u_int32_t) (-50) << 1) & 0x1ff);
-			REG_WRITE(ah, ar5416_cca_regs[i], val);
-		}
+	ath9k_hw_write_cca(ah, NULL);
+	ah->ah_calstats.cs_wait_spun += ath9k_hw_usecs_since(&mark);
+}
+
+static void ath9k_hw_cal_defer(struct ath_hal *ah, u_int32_t what)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+
+	ahp->ah_calPending |= what;
+	ahp->ah_calKick = ktime_get();
+	ah->ah_calstats.cs_deferred++;
+}
+
+/* Reload the NF history and restart NF calibration */
+static void
+ath9k_hw_restart_nf(struct ath_hal *ah, struct hal_channel_internal *chan)
+{
+	if (!ah->ah_config.ath_hal_calAsync) {
+		ath9k_hw_loadnf(ah, chan);
+		ath9k_hw_start_nfcal(ah);
+		return;
 	}
+
+	ath9k_hw_loadnf_start(ah, chan);
+	ath9k_hw_cal_defer(ah, HAL_CALPEND_NFLOAD);
 }
 
 static int16_t ath9k_hw_getnf(struct ath_hal *ah,
@@ -3138,6 +3196,7 @@ static void ath9k_set_power_sleep(struct ath_hal *ah, int setChip)
 
 		OS_REG_CLR_BIT(ah, (u_int16_t) (AR_RTC_RESET),
 			       AR_RTC_RESET_EN);
+		ath9k_hw_shadow_invalidate(ah);
 	}
 }
 
@@ -3513,6 +3572,8 @@ void ath9k_hw_detach(struct ath_hal *ah)
 	ath9k_hw_rfdetach(ah);
 
 	ath9k_hw_setpower(ah, HAL_PM_FULL_SLEEP);
+	ath9k_hw_sim_detach(ah);
+	ath9k_hw_shadow_detach(ah);
 	kfree(ah);
 }
 
@@ -4458,6 +4519,8 @@ ath9k_hw_set_txpower(struct ath_hal *ah,
 		     u_int8_t twiceMaxRegulatoryPower,
 		     u_int8_t powerLimit)
 {
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	struct hal_txpower_pre *tp = &ahp->ah_txpowPre;
 	struct modal_eep_header *pModal =
 		&(pEepData->modalHeader[IS_CHAN_2GHZ(chan)]);
 	int16_t ratesArray[Ar5416RateSize];
@@ -4473,16 +4536,26 @@ ath9k_hw_set_txpower(struct ath_hal *ah,
 		ht40PowerIncForPdadc = pModal->ht40PowerIncForPdadc;
 	}
 
-	if (!ath9k_hw_set_power_per_rate_table(ah, pEepData, chan,
-					       &ratesArray[0], cfgCtl,
-					       twiceAntennaReduction,
-					       twiceMaxRegulatoryPower,
-					       powerLimit)) {
+	if (tp->tp_chan == chan && pEepData == &ahp->ah_eeprom &&
+	    tp->tp_cfgCtl == cfgCtl &&
+	    tp->tp_antennaReduction == twiceAntennaReduction &&
+	    tp->tp_maxRegPower == twiceMaxRegulatoryPower &&
+	    tp->tp_powerLimit == powerLimit &&
+	    tp->tp_txchainmask == ahp->ah_txchainmask &&
+	    tp->tp_tpScale == ah->ah_tpScale) {
+		memcpy(ratesArray, tp->tp_rates, sizeof(ratesArray));
+		ah->ah_resetstats.rt_txpow_pre++;
+	} else if (!ath9k_hw_set_power_per_rate_table(ah, pEepData, chan,
+						      &ratesArray[0], cfgCtl,
+						      twiceAntennaReduction,
+						      twiceMaxRegulatoryPower,
+						      powerLimit)) {
 		HDPRINTF(ah, HAL_DBG_EEPROM,
 			"ath9k_hw_set_txpower: unable to set "
 			"tx power per rate table\n");
 		return HAL_EIO;
 	}
+	tp->tp_chan = NULL;
 
 	if (!ath9k_hw_set_power_cal_table
 	    (ah, pEepData, chan, &txPowerIndexOffset)) {
@@ -4594,6 +4667,61 @@ ath9k_hw_set_txpower(struct ath_hal *ah,
 	return HAL_OK;
 }
 
+/*
+ * Build the per-rate table ath9k_hw_process_ini() is going to ask for,
+ * with the same arguments.  Only eeprom data is used, so this may run
+ * while the chip cannot take register accesses.
+ */
+static void ath9k_hw_txpower_precompute(struct ath_hal *ah,
+					struct hal_channel_internal *ichan)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	struct hal_txpower_pre *tp = &ahp->ah_txpowPre;
+	struct hal_channel *chan = (struct hal_channel *) ichan;
+
+	tp->tp_chan = NULL;
+	tp->tp_cfgCtl = ath9k_regd_get_ctl(ah, chan);
+	tp->tp_antennaReduction = ath9k_regd_get_antenna_allowed(ah, chan);
+	tp->tp_maxRegPower = ichan->maxRegTxPower * 2;
+	tp->tp_powerLimit = min((u_int32_t) MAX_RATE_POWER,
+				(u_int32_t) ah->ah_powerLimit);
+	tp->tp_txchainmask = ahp->ah_txchainmask;
+	tp->tp_tpScale = ah->ah_tpScale;
+	memset(tp->tp_rates, 0, sizeof(tp->tp_rates));
+
+	if (ath9k_hw_set_power_per_rate_table(ah, &ahp->ah_eeprom, ichan,
+					      tp->tp_rates, tp->tp_cfgCtl,
+					      tp->tp_antennaReduction,
+					      tp->tp_maxRegPower,
+					      tp->tp_powerLimit))
+		tp->tp_chan = ichan;
+}
+
+/*
+ * Wait out a fixed hardware settle time.  Work the reset in progress
+ * needs later and that does not touch the chip is done inside the
+ * window instead of spinning through it.
+ */
+static void ath9k_hw_settle(struct ath_hal *ah, u_int32_t usecs)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	ktime_t mark = ktime_get();
+	u_int32_t us;
+
+	if (ahp->ah_settleChan == NULL) {
+		udelay(usecs);
+		return;
+	}
+
+	ath9k_hw_txpower_precompute(ah, ahp->ah_settleChan);
+	ahp->ah_settleChan = NULL;
+
+	us = ath9k_hw_usecs_since(&mark);
+	ah->ah_resetstats.rt_overlap += min(us, usecs);
+	if (us < usecs)
+		udelay(usecs - us);
+}
+
 static inline void ath9k_hw_get_delta_slope_vals(struct ath_hal *ah,
 						 u_int32_t coef_scaled,
 						 u_int32_t *coef_mantissa,
@@ -5359,6 +5487,13 @@ ath9k_hw_process_ini(struct ath_hal *ah,
 		return HAL_EINVAL;
 	}
 
+	if (ath9k_hw_profile_replay(ah, chan, ichan, macmode))
+		return HAL_OK;
+	ath9k_hw_profile_record(ah);
+
+	/* the tables go out in one pass, see regshadow.c */
+	ath9k_hw_shadow_buffer(ah, AH_TRUE);
+
 	REG_WRITE(ah, AR_PHY(0), 0x00000007);
 
 	REG_WRITE(ah, AR_PHY_ADC_SERIAL_CTL, AR_PHY_SEL_EXTERNAL_RADIO);
@@ -5400,6 +5535,7 @@ ath9k_hw_process_ini(struct ath_hal *ah,
 
 		if (reg >= 0x7800 && reg < 0x78a0
 		    && ah->ah_config.ath_hal_analogShiftReg) {
+			ath9k_hw_shadow_flush(ah);
 			udelay(100);
 		}
 
@@ -5414,6 +5550,7 @@ ath9k_hw_process_ini(struct ath_hal *ah,
 
 		if (reg >= 0x7800 && reg < 0x78a0
 		    && ah->ah_config.ath_hal_analogShiftReg) {
+			ath9k_hw_shadow_flush(ah);
 			udelay(100);
 		}
 
@@ -5427,6 +5564,8 @@ ath9k_hw_process_ini(struct ath_hal *ah,
 				regWrites);
 	}
 
+	ath9k_hw_shadow_buffer(ah, AH_FALSE);
+
 	ath9k_hw_override_ini(ah, chan);
 	ath9k_hw_set_regs(ah, chan, macmode);
 	ath9k_hw_init_chain_masks(ah);
@@ -5441,15 +5580,18 @@ ath9k_hw_process_ini(struct ath_hal *ah,
 	if (status != HAL_OK) {
 		HDPRINTF(ah, HAL_DBG_POWER_MGMT,
 			 "%s: error init'ing transmit power\n", __func__);
+		ath9k_hw_profile_save(ah, AH_FALSE);
 		return HAL_EIO;
 	}
 
 	if (!ath9k_hw_set_rf_regs(ah, ichan, freqIndex)) {
 		HDPRINTF(ah, HAL_DBG_REG_IO,
 			 "%s: ar5416SetRfRegs failed\n", __func__);
+		ath9k_hw_profile_save(ah, AH_FALSE);
 		return HAL_EIO;
 	}
 
+	ath9k_hw_profile_save(ah, AH_TRUE);
 	return HAL_OK;
 }
 
@@ -5543,6 +5685,7 @@ ath9k_hw_per_calibration(struct ath_hal *ah,
 				ichan->CalValid |=
 					currCal->calData->calType;
 				currCal->calState = CAL_DONE;
+				ahp->ah_calstamp = jiffies;
 				*isCalDone = AH_TRUE;
 			} else {
 				ath9k_hw_setup_calibration(ah, currCal);
@@ -5725,6 +5868,11 @@ static inline void ath9k_hw_set_dma(struct ath_hal *ah)
 
 enum hal_bool ath9k_hw_stopdmarecv(struct ath_hal *ah)
 {
+	if (ath9k_hw_sim_active(ah)) {
+		ath9k_hw_sim_rxena(ah, AH_FALSE);
+		return AH_TRUE;
+	}
+
 	REG_WRITE(ah, AR_CR, AR_CR_RXD);
 	if (!ath9k_hw_wait(ah, AR_CR, AR_CR_RXE, 0)) {
 		HDPRINTF(ah, HAL_DBG_RX, "%s: dma failed to stop in 10ms\n"
@@ -5739,6 +5887,9 @@ enum hal_bool ath9k_hw_stopdmarecv(struct ath_hal *ah)
 
 void ath9k_hw_startpcureceive(struct ath_hal *ah)
 {
+	if (ath9k_hw_sim_active(ah))
+		return;
+
 	OS_REG_CLR_BIT(ah, AR_DIAG_SW,
 		       (AR_DIAG_RX_DIS | AR_DIAG_RX_ABORT));
 
@@ -5749,6 +5900,9 @@ void ath9k_hw_startpcureceive(struct ath_hal *ah)
 
 void ath9k_hw_stoppcurecv(struct ath_hal *ah)
 {
+	if (ath9k_hw_sim_active(ah))
+		return;
+
 	OS_REG_SET_BIT(ah, AR_DIAG_SW, AR_DIAG_RX_DIS);
 
 	ath9k_hw_disable_mib_counters(ah);
@@ -5777,6 +5931,91 @@ static enum hal_bool ath9k_hw_iscal_supported(struct ath_hal *ah,
 	return retval;
 }
 
+/*
+ * Finish whatever hardware wait was left pending by the reset or the
+ * last calibration step.  Returns AH_FALSE while the hardware is still
+ * busy; the caller is expected to come back a little later.
+ */
+static enum hal_bool ath9k_hw_cal_poll(struct ath_hal *ah)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	ktime_t kick = ahp->ah_calKick;
+	u_int32_t us = (u_int32_t) ktime_to_us(ktime_sub(ktime_get(), kick));
+
+	if (ahp->ah_calPending & HAL_CALPEND_FAILED)
+		return AH_TRUE;
+
+	if (ahp->ah_calPending & HAL_CALPEND_OFFSET) {
+		if (REG_READ(ah, AR_PHY_AGC_CONTROL) & AR_PHY_AGC_CONTROL_CAL) {
+			if (us < AH_TIMEOUT)
+				return AH_FALSE;
+			HDPRINTF(ah, HAL_DBG_CALIBRATE,
+				 "%s: offset calibration failed to complete "
+				 "in %u us; noisy environment?\n",
+				 __func__, us);
+			ah->ah_calstats.cs_timeouts++;
+			/* the reset failed, as it would have synchronously */
+			ahp->ah_calPending = HAL_CALPEND_FAILED;
+			return AH_TRUE;
+		}
+		ah->ah_calstats.cs_wait_async += us;
+		ahp->ah_calPending &= ~HAL_CALPEND_OFFSET;
+
+		REG_WRITE(ah, AR_PHY_AGC_CONTROL,
+			  REG_READ(ah, AR_PHY_AGC_CONTROL) |
+			  AR_PHY_AGC_CONTROL_NF);
+
+		ath9k_hw_init_cal_done(ah, ah->ah_curchan);
+	}
+
+	if (ahp->ah_calPending & HAL_CALPEND_NFLOAD) {
+		if (REG_READ(ah, AR_PHY_AGC_CONTROL) & AR_PHY_AGC_CONTROL_NF) {
+			if (us < AH_NFLOAD_TIMEOUT)
+				return AH_FALSE;
+			ah->ah_calstats.cs_timeouts++;
+		}
+		ah->ah_calstats.cs_wait_async += us;
+		ahp->ah_calPending &= ~HAL_CALPEND_NFLOAD;
+
+		ath9k_hw_write_cca(ah, NULL);
+		ath9k_hw_start_nfcal(ah);
+	}
+
+	return AH_TRUE;
+}
+
+/* Complete a pending wait in place, e.g. before the chip is reset */
+static void ath9k_hw_cal_flush(struct ath_hal *ah)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	ktime_t mark = ktime_get();
+
+	if (ahp->ah_chipFullSleep == AH_TRUE)
+		ahp->ah_calPending = 0;
+	if (ahp->ah_calPending) {
+		while (!ath9k_hw_cal_poll(ah))
+			udelay(AH_TIME_QUANTUM);
+		ah->ah_calstats.cs_wait_spun +=
+			ath9k_hw_usecs_since(&mark);
+	}
+	/* a failed offset cal is forgotten once the chip is reset again */
+	ahp->ah_calPending = 0;
+}
+
+/*
+ * HAL_EINPROGRESS while a hardware wait is pending, HAL_ESELFTEST when
+ * the offset cal of the last reset timed out and the chip needs
+ * another reset.
+ */
+enum hal_status ath9k_hw_cal_status(struct ath_hal *ah)
+{
+	u_int32_t pending = AH5416(ah)->ah_calPending;
+
+	if (pending & HAL_CALPEND_FAILED)
+		return HAL_ESELFTEST;
+	return pending ? HAL_EINPROGRESS : HAL_OK;
+}
+
 static inline enum hal_bool ath9k_hw_init_cal(struct ath_hal *ah,
 					      struct hal_channel *chan)
 {
@@ -5784,21 +6023,30 @@ static inline enum hal_bool ath9k_hw_init_cal(struct ath_hal *ah,
 	struct hal_channel_internal *ichan =
 		ath9k_regd_check_channel(ah, chan);
 
+	ktime_t mark;
+
 	REG_WRITE(ah, AR_PHY_AGC_CONTROL,
 		  REG_READ(ah, AR_PHY_AGC_CONTROL) |
 		  AR_PHY_AGC_CONTROL_CAL);
 
-	if (!ath9k_hw_wait
-	    (ah, AR_PHY_AGC_CONTROL, AR_PHY_AGC_CONTROL_CAL, 0)) {
-		HDPRINTF(ah, HAL_DBG_CALIBRATE,
-			 "%s: offset calibration failed to complete in 1ms; "
-			 "noisy environment?\n", __func__);
-		return AH_FALSE;
-	}
+	if (ah->ah_config.ath_hal_calAsync) {
+		/* NF and the periodic cals start from ath9k_hw_cal_poll() */
+		ath9k_hw_cal_defer(ah, HAL_CALPEND_OFFSET);
+	} else {
+		mark = ktime_get();
+		if (!ath9k_hw_wait
+		    (ah, AR_PHY_AGC_CONTROL, AR_PHY_AGC_CONTROL_CAL, 0)) {
+			HDPRINTF(ah, HAL_DBG_CALIBRATE,
+				 "%s: offset calibration failed to complete "
+				 "in 1ms; noisy environment?\n", __func__);
+			return AH_FALSE;
+		}
+		ah->ah_calstats.cs_wait_spun += ath9k_hw_usecs_since(&mark);
 
-	REG_WRITE(ah, AR_PHY_AGC_CONTROL,
-		  REG_READ(ah, AR_PHY_AGC_CONTROL) |
-		  AR_PHY_AGC_CONTROL_NF);
+		REG_WRITE(ah, AR_PHY_AGC_CONTROL,
+			  REG_READ(ah, AR_PHY_AGC_CONTROL) |
+			  AR_PHY_AGC_CONTROL_NF);
+	}
 
 	ahp->ah_cal_list = ahp->ah_cal_list_last = ahp->ah_cal_list_curr =
 		NULL;
@@ -5831,7 +6079,8 @@ static inline enum hal_bool ath9k_hw_init_cal(struct ath_hal *ah,
 
 		ahp->ah_cal_list_curr = ahp->ah_cal_list;
 
-		if (ahp->ah_cal_list_curr)
+		if (ahp->ah_cal_list_curr &&
+		    !(ahp->ah_calPending & HAL_CALPEND_OFFSET))
 			ath9k_hw_reset_calibration(ah,
 						   ahp->ah_cal_list_curr);
 	}
@@ -5842,6 +6091,252 @@ static inline enum hal_bool ath9k_hw_init_cal(struct ath_hal *ah,
 }
 
 
+/*
+ * Per-channel calibration snapshots.  When a channel is left its NF
+ * history and the IQ / ADC gain / ADC DC corrections the periodic cals
+ * produced are stashed; coming back within ath_hal_calSnapAge seconds
+ * puts them back and marks those cals done instead of starting over.
+ */
+static struct hal_cal_snapshot *
+ath9k_hw_calsnap_find(struct ath_hal *ah,
+		      struct hal_channel_internal *ichan,
+		      enum hal_bool alloc)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	struct hal_cal_snapshot *cs, *lru = NULL;
+	u_int32_t flags = ichan->channelFlags & CHANNEL_ALL;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ahp->ah_calsnap); i++) {
+		cs = &ahp->ah_calsnap[i];
+		if (cs->cs_channel == ichan->channel &&
+		    cs->cs_channelFlags == flags)
+			return cs;
+		if (!alloc || (lru != NULL && lru->cs_channel == 0))
+			continue;
+		if (lru == NULL || cs->cs_channel == 0 ||
+		    time_before(cs->cs_nfstamp, lru->cs_nfstamp))
+			lru = cs;
+	}
+
+	if (lru != NULL) {
+		memset(lru, 0, sizeof(*lru));
+		lru->cs_channel = ichan->channel;
+		lru->cs_channelFlags = flags;
+	}
+	return lru;
+}
+
+static void ath9k_hw_calsnap_save(struct ath_hal *ah,
+				  struct hal_channel_internal *ichan,
+				  u_int8_t rxchainmask)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	struct hal_cal_snapshot *cs;
+	int i;
+
+	cs = ath9k_hw_calsnap_find(ah, ichan, AH_TRUE);
+	cs->cs_nfstamp = jiffies;
+	cs->cs_calstamp = ahp->ah_calstamp;
+	cs->cs_calValid = ichan->CalValid;
+	cs->cs_rxchainmask = rxchainmask;
+
+	for (i = 0; i < AR5416_MAX_CHAINS; i++) {
+		if (!(rxchainmask & (1 << i)))
+			continue;
+		cs->cs_iqCorr[i] = REG_READ(ah, AR_PHY_TIMING_CTRL4(i)) &
+			(AR_PHY_TIMING_CTRL4_IQCORR_Q_I_COFF |
+			 AR_PHY_TIMING_CTRL4_IQCORR_Q_Q_COFF);
+		cs->cs_adcCorr[i] =
+			REG_READ(ah, AR_PHY_NEW_ADC_DC_GAIN_CORR(i)) &
+			0x3fffffff;
+	}
+#ifndef ATH_NF_PER_CHAN
+	memcpy(cs->cs_nfCalHist, ah->nfCalHist, sizeof(cs->cs_nfCalHist));
+#endif
+	ah->ah_calstats.cs_saved++;
+
+	HDPRINTF(ah, HAL_DBG_CALIBRATE,
+		 "%s: saved channel %u/0x%x calValid 0x%x\n", __func__,
+		 ichan->channel, ichan->channelFlags, ichan->CalValid);
+}
+
+static void ath9k_hw_calsnap_apply(struct ath_hal *ah,
+				   struct hal_cal_snapshot *cs,
+				   int32_t calValid)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	int i;
+
+	for (i = 0; i < AR5416_MAX_CHAINS; i++) {
+		if (!(ahp->ah_rxchainmask & cs->cs_rxchainmask & (1 << i)))
+			continue;
+		if (calValid & IQ_MISMATCH_CAL)
+			OS_REG_RMW(ah, AR_PHY_TIMING_CTRL4(i),
+				   cs->cs_iqCorr[i],
+				   AR_PHY_TIMING_CTRL4_IQCORR_Q_I_COFF |
+				   AR_PHY_TIMING_CTRL4_IQCORR_Q_Q_COFF);
+		if (calValid & ADC_GAIN_CAL)
+			OS_REG_RMW(ah, AR_PHY_NEW_ADC_DC_GAIN_CORR(i),
+				   cs->cs_adcCorr[i] & 0x00000fff, 0x00000fff);
+		if (calValid & ADC_DC_CAL)
+			OS_REG_RMW(ah, AR_PHY_NEW_ADC_DC_GAIN_CORR(i),
+				   cs->cs_adcCorr[i] & 0x3ffff000, 0x3ffff000);
+	}
+
+	if (calValid & IQ_MISMATCH_CAL)
+		OS_REG_SET_BIT(ah, AR_PHY_TIMING_CTRL4(0),
+			       AR_PHY_TIMING_CTRL4_IQCORR_ENABLE);
+	if (calValid & ADC_GAIN_CAL)
+		OS_REG_SET_BIT(ah, AR_PHY_NEW_ADC_DC_GAIN_CORR(0),
+			       AR_PHY_NEW_ADC_GAIN_CORR_ENABLE);
+	if (calValid & ADC_DC_CAL)
+		OS_REG_SET_BIT(ah, AR_PHY_NEW_ADC_DC_GAIN_CORR(0),
+			       AR_PHY_NEW_ADC_DC_OFFSET_CORR_ENABLE);
+}
+
+static void ath9k_hw_calsnap_restore(struct ath_hal *ah,
+				     struct hal_channel_internal *ichan)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	struct hal_cal_list *cal, *first = NULL;
+	struct hal_cal_snapshot *cs;
+	unsigned long maxage = ah->ah_config.ath_hal_calSnapAge * HZ;
+	int32_t calValid = 0, restored = 0;
+
+	ahp->ah_calstamp = 0;
+
+	cs = ath9k_hw_calsnap_find(ah, ichan, AH_FALSE);
+	if (cs != NULL && time_after(jiffies, cs->cs_nfstamp + maxage)) {
+		cs->cs_channel = 0;
+		cs = NULL;
+		ah->ah_calstats.cs_stale++;
+	}
+
+	if (cs == NULL) {
+#ifndef ATH_NF_PER_CHAN
+		ath9k_init_nfcal_hist_buffer(ah);
+#endif
+		ah->ah_calstats.cs_cold++;
+	} else {
+#ifndef ATH_NF_PER_CHAN
+		memcpy(ah->nfCalHist, cs->cs_nfCalHist,
+		       sizeof(ah->nfCalHist));
+#endif
+		if (!time_after(jiffies, cs->cs_calstamp + maxage))
+			calValid = cs->cs_calValid;
+		ah->ah_calstats.cs_warm++;
+	}
+
+	cal = ahp->ah_cal_list;
+	if (cal != NULL) {
+		do {
+			if (calValid & cal->calData->calType) {
+				cal->calState = CAL_DONE;
+				restored |= cal->calData->calType;
+				ah->ah_calstats.cs_restored++;
+			} else {
+				cal->calState = CAL_WAITING;
+				if (first == NULL)
+					first = cal;
+			}
+			cal = cal->calNext;
+		} while (cal != ahp->ah_cal_list);
+
+		if (first != NULL) {
+			ahp->ah_cal_list_curr = first;
+			ath9k_hw_reset_calibration(ah, first);
+		}
+	}
+
+	if (restored) {
+		ath9k_hw_calsnap_apply(ah, cs, restored);
+		ahp->ah_calstamp = cs->cs_calstamp;
+	}
+	ichan->CalValid = restored;
+
+	HDPRINTF(ah, HAL_DBG_CALIBRATE,
+		 "%s: channel %u/0x%x %s, calValid 0x%x\n", __func__,
+		 ichan->channel, ichan->channelFlags,
+		 cs != NULL ? "warm" : "cold", restored);
+}
+
+/*
+ * Rest of the reset once the AGC offset cal is done, from the reset
+ * itself or from ath9k_hw_cal_poll(): put back the state kept for the
+ * channel and narrow the chain masks ath9k_hw_init_chain_masks()
+ * widened for the cal.
+ */
+static void ath9k_hw_init_cal_done(struct ath_hal *ah,
+				   struct hal_channel_internal *ichan)
+{
+	int rx_chainmask = AH5416(ah)->ah_rxchainmask;
+
+	ath9k_hw_calsnap_restore(ah, ichan);
+
+	if ((rx_chainmask == 0x5) || (rx_chainmask == 0x3)) {
+		REG_WRITE(ah, AR_PHY_RX_CHAINMASK, rx_chainmask);
+		REG_WRITE(ah, AR_PHY_CAL_CHAINMASK, rx_chainmask);
+	}
+}
+
+
+static inline struct hal_reset_trace *
+ath9k_hw_reset_trace(struct ath_hal *ah)
+{
+	return &ah->ah_resettrace[ah->ah_resettrace_seq % HAL_RESET_TRACE_LEN];
+}
+
+static inline void ath9k_hw_reset_phase(struct ath_hal *ah,
+					enum hal_reset_phase phase,
+					ktime_t *mark)
+{
+	struct hal_reset_stats *rt = &ah->ah_resetstats;
+	u_int32_t us = ath9k_hw_usecs_since(mark);
+
+	rt->rt_last[phase] = us;
+	rt->rt_total[phase] += us;
+	if (us > rt->rt_max[phase])
+		rt->rt_max[phase] = us;
+	ath9k_hw_reset_trace(ah)->tr_phase[phase] = us;
+}
+
+static void ath9k_hw_reset_trace_start(struct ath_hal *ah,
+				       struct hal_channel *chan)
+{
+	struct hal_reset_trace *tr;
+
+	ah->ah_resettrace_seq++;
+	tr = ath9k_hw_reset_trace(ah);
+	memset(tr, 0, sizeof(*tr));
+	tr->tr_seq = ah->ah_resettrace_seq;
+	tr->tr_channel = chan->channel;
+	tr->tr_channelFlags = chan->channelFlags;
+}
+
+static void ath9k_hw_reset_trace_end(struct ath_hal *ah, ktime_t *start,
+				     enum hal_bool fastchan,
+				     enum hal_status status)
+{
+	struct hal_reset_trace *tr = ath9k_hw_reset_trace(ah);
+	int i;
+
+	tr->tr_total = ath9k_hw_usecs_since(start);
+	tr->tr_fastchan = fastchan;
+	tr->tr_status = status;
+
+	HDPRINTF(ah, HAL_DBG_RESET, "%s: #%u %u/0x%x %s status %d, %u us\n",
+		 __func__, tr->tr_seq, tr->tr_channel, tr->tr_channelFlags,
+		 fastchan ? "fast" : "full", status, tr->tr_total);
+
+	if (tr->tr_total < HAL_RESET_SLOW_US)
+		return;
+	ah->ah_resetstats.rt_slow++;
+	for (i = 0; i < HAL_RESET_PHASE_MAX; i++)
+		HDPRINTF(ah, HAL_DBG_RESET, "%s: #%u slow, phase %d %u us\n",
+			 __func__, tr->tr_seq, i, tr->tr_phase[i]);
+}
+
 enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 			     struct hal_channel *chan,
 			     enum hal_ht_macmode macmode,
@@ -5858,7 +6353,13 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 	u_int32_t saveDefAntenna;
 	u_int32_t macStaId1;
 	enum hal_status ecode;
-	int i, rx_chainmask;
+	int i;
+	u_int8_t rxmask = ahp->ah_rxchainmask;
+	ktime_t mark = ktime_get();
+	ktime_t start = mark;
+
+	ath9k_hw_shadow_reset(ah, AH_FALSE);
+	ath9k_hw_reset_trace_start(ah, chan);
 
 	ahp->ah_extprotspacing = extprotspacing;
 	ahp->ah_txchainmask = txchainmask;
@@ -5877,11 +6378,28 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 		FAIL(HAL_EINVAL);
 	}
 
+	/* the chip model has no PHY or MAC to bring up */
+	if (ath9k_hw_sim_active(ah)) {
+		ath9k_hw_sim_reset(ah);
+		ah->ah_curchan = ichan;
+		chan->channelFlags = ichan->channelFlags;
+		chan->privFlags = ichan->privFlags;
+		ah->ah_resetstats.rt_resets++;
+		ath9k_hw_reset_trace_end(ah, &start, AH_FALSE, HAL_OK);
+		ath9k_hw_shadow_reset(ah, AH_TRUE);
+		return AH_TRUE;
+	}
+
 	if (!ath9k_hw_setpower(ah, HAL_PM_AWAKE))
-		return AH_FALSE;
+		FAIL(HAL_EIO);
+
+	ath9k_hw_cal_flush(ah);
 
-	if (curchan)
+	if (curchan) {
 		ath9k_hw_getnf(ah, curchan);
+		if (ahp->ah_chipFullSleep != AH_TRUE)
+			ath9k_hw_calsnap_save(ah, curchan, rxmask);
+	}
 
 	if (bChannelChange &&
 	    (ahp->ah_chipFullSleep != AH_TRUE) &&
@@ -5897,14 +6415,20 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 			chan->channelFlags = ichan->channelFlags;
 			chan->privFlags = ichan->privFlags;
 
-			ath9k_hw_loadnf(ah, ah->ah_curchan);
-
-			ath9k_hw_start_nfcal(ah);
+			ath9k_hw_calsnap_restore(ah, ichan);
+			ath9k_hw_restart_nf(ah, ah->ah_curchan);
 
+			ah->ah_resetstats.rt_fastchan++;
+			ah->ah_resetstats.rt_fastchan_last =
+				ath9k_hw_usecs_since(&mark);
+			ath9k_hw_reset_trace_end(ah, &start, AH_TRUE, HAL_OK);
+			ath9k_hw_shadow_reset(ah, AH_TRUE);
 			return AH_TRUE;
 		}
 	}
 
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_PREP, &mark);
+
 	saveDefAntenna = REG_READ(ah, AR_DEF_ANTENNA);
 	if (saveDefAntenna == 0)
 		saveDefAntenna = 1;
@@ -5917,11 +6441,15 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 
 	ath9k_hw_mark_phy_inactive(ah);
 
+	/* the txpower table is built while the PLL settles */
+	ahp->ah_settleChan = ichan;
 	if (!ath9k_hw_chip_reset(ah, chan)) {
+		ahp->ah_settleChan = NULL;
 		HDPRINTF(ah, HAL_DBG_RESET, "%s: chip reset failed\n",
 			 __func__);
 		FAIL(HAL_EIO);
 	}
+	ahp->ah_settleChan = NULL;
 
 	if (AR_SREV_9280(ah)) {
 		OS_REG_SET_BIT(ah, AR_GPIO_INPUT_EN_VAL,
@@ -5935,10 +6463,12 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 		}
 		ath9k_hw_cfg_output(ah, 9, HAL_GPIO_OUTPUT_MUX_AS_OUTPUT);
 	}
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_CHIP, &mark);
 
 	ecode = ath9k_hw_process_ini(ah, chan, ichan, macmode);
 	if (ecode != HAL_OK)
 		goto bad;
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_INI, &mark);
 
 	if (IS_CHAN_OFDM(chan) || IS_CHAN_HT(chan))
 		ath9k_hw_set_delta_slope(ah, ichan);
@@ -5955,6 +6485,7 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 	}
 
 	ath9k_hw_decrease_chain_power(ah, chan);
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_SPUR, &mark);
 
 	REG_WRITE(ah, AR_STA_ID0, LE_READ_4(ahp->ah_macaddr));
 	REG_WRITE(ah, AR_STA_ID1, LE_READ_2(ahp->ah_macaddr + 4)
@@ -5985,6 +6516,7 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 		if (!(ath9k_hw_set_channel(ah, ichan)))
 			FAIL(HAL_EIO);
 	}
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_CHANNEL, &mark);
 
 	for (i = 0; i < AR_NUM_DCU; i++)
 		REG_WRITE(ah, AR_DQCUMASK(i), 1 << i);
@@ -6009,20 +6541,22 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 
 	if (ahp->ah_intrMitigation) {
 
-		OS_REG_RMW_FIELD(ah, AR_RIMT, AR_RIMT_LAST, 500);
-		OS_REG_RMW_FIELD(ah, AR_RIMT, AR_RIMT_FIRST, 2000);
+		OS_REG_RMW_FIELD(ah, AR_RIMT, AR_RIMT_LAST, ahp->ah_rimtLast);
+		OS_REG_RMW_FIELD(ah, AR_RIMT, AR_RIMT_FIRST,
+				 ahp->ah_rimtFirst);
 	}
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_MAC, &mark);
 
 	ath9k_hw_init_bb(ah, chan);
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_BB, &mark);
 
 	if (!ath9k_hw_init_cal(ah, chan))
 		FAIL(HAL_ESELFTEST);
 
-	rx_chainmask = ahp->ah_rxchainmask;
-	if ((rx_chainmask == 0x5) || (rx_chainmask == 0x3)) {
-		REG_WRITE(ah, AR_PHY_RX_CHAINMASK, rx_chainmask);
-		REG_WRITE(ah, AR_PHY_CAL_CHAINMASK, rx_chainmask);
-	}
+	/* else the cal still runs on the widened chains */
+	if (!(ahp->ah_calPending & HAL_CALPEND_OFFSET))
+		ath9k_hw_init_cal_done(ah, ichan);
+	ath9k_hw_reset_phase(ah, HAL_RESET_PHASE_CAL, &mark);
 
 	REG_WRITE(ah, AR_CFG_LED, saveLedState | AR_CFG_SCLK_32KHZ);
 
@@ -6048,8 +6582,13 @@ enum hal_bool ath9k_hw_reset(struct ath_hal *ah, enum hal_opmode opmode,
 	}
 	chan->channelFlags = ichan->channelFlags;
 	chan->privFlags = ichan->privFlags;
+	ah->ah_resetstats.rt_resets++;
+	ath9k_hw_reset_trace_end(ah, &start, AH_FALSE, HAL_OK);
+	ath9k_hw_shadow_reset(ah, AH_TRUE);
 	return AH_TRUE;
 bad:
+	ath9k_hw_reset_trace_end(ah, &start, AH_FALSE, ecode);
+	ath9k_hw_shadow_reset(ah, AH_TRUE);
 	if (status)
 		*status = ecode;
 	return AH_FALSE;
@@ -6078,6 +6617,9 @@ ath9k_hw_calibrate(struct ath_hal *ah, struct hal_channel *chan,
 	struct hal_cal_list *currCal = ahp->ah_cal_list_curr;
 	struct hal_channel_internal *ichan =
 		ath9k_regd_check_channel(ah, chan);
+	struct hal_cal_stats *cs = &ah->ah_calstats;
+	ktime_t mark = ktime_get();
+	u_int32_t us;
 
 	*isCalDone = AH_TRUE;
 
@@ -6088,6 +6630,20 @@ ath9k_hw_calibrate(struct ath_hal *ah, struct hal_channel *chan,
 		return AH_FALSE;
 	}
 
+	/* nothing to calibrate in the chip model */
+	if (ath9k_hw_sim_active(ah))
+		return AH_TRUE;
+
+	if (ahp->ah_calPending && !ath9k_hw_cal_poll(ah)) {
+		*isCalDone = AH_FALSE;
+		goto done;
+	}
+	if (ahp->ah_calPending & HAL_CALPEND_FAILED) {
+		*isCalDone = AH_FALSE;
+		return AH_FALSE;
+	}
+	currCal = ahp->ah_cal_list_curr;
+
 	if (currCal &&
 	    (currCal->calState == CAL_RUNNING ||
 	     currCal->calState == CAL_WAITING)) {
@@ -6105,8 +6661,7 @@ ath9k_hw_calibrate(struct ath_hal *ah, struct hal_channel *chan,
 
 	if (longcal) {
 		ath9k_hw_getnf(ah, ichan);
-		ath9k_hw_loadnf(ah, ah->ah_curchan);
-		ath9k_hw_start_nfcal(ah);
+		ath9k_hw_restart_nf(ah, ah->ah_curchan);
 
 		if ((ichan->channelFlags & CHANNEL_CW_INT) != 0) {
 
@@ -6115,6 +6670,13 @@ ath9k_hw_calibrate(struct ath_hal *ah, struct hal_channel *chan,
 		}
 	}
 
+done:
+	us = ath9k_hw_usecs_since(&mark);
+	cs->cs_steps++;
+	cs->cs_step_last = us;
+	cs->cs_step_total += us;
+	if (us > cs->cs_step_max)
+		cs->cs_step_max = us;
 	return AH_TRUE;
 }
 
@@ -6790,6 +7352,9 @@ enum hal_bool ath9k_hw_intrpend(struct ath_hal *ah)
 {
 	u_int32_t host_isr;
 
+	if (ath9k_hw_sim_active(ah))
+		return ath9k_hw_sim_intrpend(ah);
+
 	if (AR_SREV_9100(ah))
 		return AH_TRUE;
 
@@ -6813,6 +7378,9 @@ enum hal_bool ath9k_hw_getisr(struct ath_hal *ah, enum hal_int *masked)
 	u_int32_t sync_cause = 0;
 	enum hal_bool fatal_int = AH_FALSE;
 
+	if (ath9k_hw_sim_active(ah))
+		return ath9k_hw_sim_getisr(ah, masked);
+
 	if (!AR_SREV_9100(ah)) {
 		if (REG_READ(ah, AR_INTR_ASYNC_CAUSE) & AR_INTR_MAC_IRQ) {
 			if ((REG_READ(ah, AR_RTC_STATUS) & AR_RTC_STATUS_M)
@@ -6957,6 +7525,9 @@ enum hal_int ath9k_hw_set_interrupts(struct ath_hal *ah, enum hal_int ints)
 	HDPRINTF(ah, HAL_DBG_INTERRUPT, "%s: 0x%x => 0x%x\n", __func__,
 		 omask, ints);
 
+	if (ath9k_hw_sim_active(ah))
+		return ath9k_hw_sim_set_interrupts(ah, ints);
+
 	if (omask & HAL_INT_GLOBAL) {
 		HDPRINTF(ah, HAL_DBG_INTERRUPT, "%s: disable IER\n",
 			 __func__);
@@ -7056,6 +7627,31 @@ enum hal_int ath9k_hw_set_interrupts(struct ath_hal *ah, enum hal_int ints)
 	return omask;
 }
 
+/*
+ * Set the rx interrupt mitigation timers: an interrupt is raised once
+ * the receiver has been quiet for 'last' usec, or 'first' usec after
+ * the first frame, whichever comes first. Zero for both turns
+ * mitigation off and restores the per-frame RXOK interrupt. The new
+ * mask takes effect on the next ath9k_hw_set_interrupts().
+ */
+void ath9k_hw_set_rxmitigation(struct ath_hal *ah,
+			       u_int32_t last, u_int32_t first)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+
+	ahp->ah_rimtLast = min(last, (u_int32_t) MS(AR_RIMT_LAST,
+						    AR_RIMT_LAST));
+	ahp->ah_rimtFirst = min(first, (u_int32_t) MS(AR_RIMT_FIRST,
+						      AR_RIMT_FIRST));
+	ahp->ah_intrMitigation = (last || first) ? AH_TRUE : AH_FALSE;
+
+	if (ath9k_hw_sim_active(ah) || !ahp->ah_intrMitigation)
+		return;
+
+	OS_REG_RMW_FIELD(ah, AR_RIMT, AR_RIMT_LAST, ahp->ah_rimtLast);
+	OS_REG_RMW_FIELD(ah, AR_RIMT, AR_RIMT_FIRST, ahp->ah_rimtFirst);
+}
+
 void
 ath9k_hw_beaconinit(struct ath_hal *ah,
 		    u_int32_t next_beacon, u_int32_t beacon_period)
@@ -8130,11 +8726,19 @@ ath9k_hw_set11n_virtualmorefrag(struct ath_hal *ah, struct ath_desc *ds,
 
 void ath9k_hw_putrxbuf(struct ath_hal *ah, u_int32_t rxdp)
 {
+	if (ath9k_hw_sim_active(ah)) {
+		ath9k_hw_sim_putrxbuf(ah, rxdp);
+		return;
+	}
 	REG_WRITE(ah, AR_RXDP, rxdp);
 }
 
 void ath9k_hw_rxena(struct ath_hal *ah)
 {
+	if (ath9k_hw_sim_active(ah)) {
+		ath9k_hw_sim_rxena(ah, AH_TRUE);
+		return;
+	}
 	REG_WRITE(ah, AR_CR, AR_CR_RXE);
 }
 
@@ -8369,6 +8973,8 @@ struct ath_hal *ath9k_hw_attach(u_int16_t devid, void *sc, void __iomem *mem,
 		ah->ah_phyRev = ah->ah_phyRev;
 		ah->ah_analog5GhzRev = ah->ah_analog5GhzRev;
 		ah->ah_analog2GhzRev = ah->ah_analog2GhzRev;
+		ath9k_hw_sim_attach(ah);
+		ath9k_hw_shadow_attach(ah);
 	}
 	return ah;
 }
@@ -8515,12 +9121,18 @@ enum hal_bool ath9k_hw_phycounters(struct ath_hal *ah)
 
 u_int32_t ath9k_hw_gettxbuf(struct ath_hal *ah, u_int q)
 {
+	if (ath9k_hw_sim_active(ah))
+		return ath9k_hw_sim_gettxbuf(ah, q);
+
 	return REG_READ(ah, AR_QTXDP(q));
 }
 
 enum hal_bool ath9k_hw_puttxbuf(struct ath_hal *ah, u_int q,
 				u_int32_t txdp)
 {
+	if (ath9k_hw_sim_active(ah))
+		return ath9k_hw_sim_puttxbuf(ah, q, txdp);
+
 	REG_WRITE(ah, AR_QTXDP(q), txdp);
 
 	return AH_TRUE;
@@ -8530,6 +9142,9 @@ enum hal_bool ath9k_hw_txstart(struct ath_hal *ah, u_int q)
 {
 	HDPRINTF(ah, HAL_DBG_QUEUE, "%s: queue %u\n", __func__, q);
 
+	if (ath9k_hw_sim_active(ah))
+		return ath9k_hw_sim_txstart(ah, q);
+
 	REG_WRITE(ah, AR_Q_TXE, 1 << q);
 
 	return AH_TRUE;
@@ -8539,6 +9154,10 @@ u_int32_t ath9k_hw_numtxpending(struct ath_hal *ah, u_int q)
 {
 	u_int32_t npend;
 
+	/* the chip model completes descriptors as soon as TxE is set */
+	if (ath9k_hw_sim_active(ah))
+		return 0;
+
 	npend = REG_READ(ah, AR_QSTS(q)) & AR_Q_STS_PEND_FR_CNT;
 	if (npend == 0) {
 
@@ -8552,6 +9171,10 @@ enum hal_bool ath9k_hw_stoptxdma(struct ath_hal *ah, u_int q)
 {
 	u_int wait;
 
+	/* nothing is ever in flight in the chip model */
+	if (ath9k_hw_sim_active(ah))
+		return AH_TRUE;
+
 	REG_WRITE(ah, AR_Q_TXD, 1 << q);
 
 	for (wait = 1000; wait != 0; wait--) {
@@ -19,6 +19,7 @@
 
 #include <linux/if_ether.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
 
 struct ar5416_desc {
 	u_int32_t ds_link;
@@ -693,6 +694,34 @@ struct hal_cal_list {
 	struct hal_cal_list *calNext;
 };
 
+/* per-rate txpower table built while the PLL settles */
+struct hal_txpower_pre {
+	struct hal_channel_internal *tp_chan;	/* NULL when unused */
+	u_int16_t tp_cfgCtl;
+	u_int8_t tp_antennaReduction;
+	u_int8_t tp_maxRegPower;
+	u_int8_t tp_powerLimit;
+	u_int8_t tp_txchainmask;
+	u_int tp_tpScale;
+	int16_t tp_rates[Ar5416RateSize];
+};
+
+#define HAL_CALSNAP_MAX    32
+
+struct hal_cal_snapshot {
+	u_int16_t cs_channel;
+	u_int32_t cs_channelFlags;
+	unsigned long cs_nfstamp;	/* jiffies the channel was left */
+	unsigned long cs_calstamp;	/* jiffies of the last periodic cal */
+	int32_t cs_calValid;
+	u_int8_t cs_rxchainmask;
+	u_int32_t cs_iqCorr[AR5416_MAX_CHAINS];
+	u_int32_t cs_adcCorr[AR5416_MAX_CHAINS];
+#ifndef ATH_NF_PER_CHAN
+	struct hal_nfcal_hist cs_nfCalHist[NUM_NF_READINGS];
+#endif
+};
+
 struct ath_hal_5416 {
 	struct ath_hal ah;
 	struct ar5416_eeprom ah_eeprom;
@@ -723,6 +752,15 @@ struct ath_hal_5416 {
 	struct hal_cal_list *ah_cal_list;
 	struct hal_cal_list *ah_cal_list_last;
 	struct hal_cal_list *ah_cal_list_curr;
+	unsigned long ah_calstamp;
+	u_int32_t ah_calPending;
+#define HAL_CALPEND_OFFSET	0x1	/* AGC offset cal from reset */
+#define HAL_CALPEND_NFLOAD	0x2	/* NF history load */
+#define HAL_CALPEND_FAILED	0x4	/* offset cal timed out */
+	ktime_t ah_calKick;
+	struct hal_channel_internal *ah_settleChan; /* txpower to build */
+	struct hal_txpower_pre ah_txpowPre;
+	struct hal_cal_snapshot ah_calsnap[HAL_CALSNAP_MAX];
 #define ah_totalPowerMeasI ah_Meas0.unsign
 #define ah_totalPowerMeasQ ah_Meas1.unsign
 #define ah_totalIqCorrMeas ah_Meas2.sign
@@ -793,6 +831,8 @@ struct ath_hal_5416 {
 	u_int16_t ah_ratesArray[16];
 	u_int32_t ah_intrTxqs;
 	enum hal_bool ah_intrMitigation;
+	u_int32_t ah_rimtLast;		/* usec of rx quiet before intr */
+	u_int32_t ah_rimtFirst;		/* usec cap from first rx frame */
 	u_int32_t ah_cycleCount;
 	u_int32_t ah_ctlBusy;
 	u_int32_t ah_extBusy;
@@ -922,6 +962,7 @@ struct ath_hal_5416 {
 
 #define AH_TIMEOUT         100000
 #define AH_TIME_QUANTUM        10
+#define AH_NFLOAD_TIMEOUT   10000
 
 #define IS(_c, _f)       (((_c)->channelFlags & _f) || 0)
 
@@ -624,13 +624,12 @@ static void ath9k_sta_notify(struct ieee80211_hw *hw,
 	switch (cmd) {
 	case STA_NOTIFY_ADD:
 		spin_lock_irqsave(&sc->node_lock, flags);
-		if (!an) {
+		/* a node on its way out is replaced, not revived */
+		if (!an || !ath_node_get(sc, (u8 *)addr)) {
 			ath_node_attach(sc, (u8 *)addr, 0);
 			DPRINTF(sc, ATH_DEBUG_NODE, "%s: Attach a node: %s\n",
 				__func__,
 				print_mac(mac, addr));
-		} else {
-			ath_node_get(sc, (u8 *)addr);
 		}
 		spin_unlock_irqrestore(&sc->node_lock, flags);
 		break;
@@ -745,6 +744,9 @@ static void ath9k_ht_conf(struct ath_softc *sc,
 					bss_conf->ht_conf->ampdu_factor);
 		ht_info->mpdudensity =
 			parse_mpdudensity(bss_conf->ht_conf->ampdu_density);
+		ht_info->maxamsdu = (bss_conf->ht_conf->cap &
+				     IEEE80211_HT_CAP_MAX_AMSDU) ?
+			ATH_AMSDU_LIMIT_MAX : ATH_AMSDU_LIMIT_DEFAULT;
 
 	}
 
@@ -1130,16 +1132,16 @@ void ath_tx_complete(struct ath_softc *sc, struct sk_buff *skb,
 		ath_node_put(sc, an, ATH9K_BH_STATUS_CHANGE);
 }
 
-int ath__rx_indicate(struct ath_softc *sc,
-		     struct sk_buff *skb,
-		     struct ath_recv_status *status,
-		     u_int16_t keyix)
+static void ath_rx_indicate_one(struct ath_softc *sc,
+				struct ath_rx_pending *rxp)
 {
 	struct ieee80211_hw *hw = sc->hw;
-	struct ath_node *an = NULL;
+	struct sk_buff *skb = rxp->skb;
+	struct ath_recv_status *status = &rxp->status;
 	struct ieee80211_rx_status rx_status;
-	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct ieee80211_hdr *hdr;
 	int hdrlen = ieee80211_get_hdrlen_from_skb(skb);
+	u_int16_t keyix = rxp->keyix;
 	int padsize;
 	enum ATH_RX_TYPE st;
 
@@ -1149,6 +1151,7 @@ int ath__rx_indicate(struct ath_softc *sc,
 		memmove(skb->data + padsize, skb->data, hdrlen);
 		skb_pull(skb, padsize);
 	}
+	hdr = (struct ieee80211_hdr *) skb->data;
 
 	/* remove FCS before passing up to protocol stack */
 	skb_trim(skb, (skb->len - FCS_LEN));
@@ -1168,19 +1171,46 @@ int ath__rx_indicate(struct ath_softc *sc,
 			rx_status.flag |= RX_FLAG_DECRYPTED;
 	}
 
-	spin_lock_bh(&sc->node_lock);
-	an = ath_node_find(sc, hdr->addr2);
-	spin_unlock_bh(&sc->node_lock);
-
-	if (an) {
-		ath_rx_input(sc, an,
+	if (rxp->an) {
+		ath_rx_input(sc, rxp->an,
 			     hw->conf.ht_conf.ht_supported,
 			     skb, status, &st);
 	}
-	if (!an || (st != ATH_RX_CONSUMED))
+	if (!rxp->an || (st != ATH_RX_CONSUMED))
 		__ieee80211_rx(hw, skb, &rx_status);
+}
 
-	return 0;
+/*
+ * Hand a batch of received frames to mac80211.
+ *
+ * Nodes are resolved from the rcu node table without taking node_lock,
+ * and the lookup is only repeated when the transmitter address changes,
+ * since frames from one peer (e.g. the subframes of an A-MPDU) arrive
+ * back to back. The read side is held across delivery so a node freed
+ * by a concurrent detach stays valid until the batch is done.
+ */
+void ath__rx_indicate(struct ath_softc *sc,
+		      struct ath_rx_pending *rxp,
+		      int n)
+{
+	struct ieee80211_hdr *hdr;
+	struct ath_node *an = NULL;
+	u8 *ta = NULL;
+	int i;
+
+	rcu_read_lock();
+	for (i = 0; i < n; i++) {
+		hdr = (struct ieee80211_hdr *) rxp[i].skb->data;
+		if (ta == NULL || compare_ether_addr(ta, hdr->addr2)) {
+			ta = hdr->addr2;
+			an = ath_node_find(sc, ta);
+		}
+		rxp[i].an = an;
+	}
+
+	for (i = 0; i < n; i++)
+		ath_rx_indicate_one(sc, &rxp[i]);
+	rcu_read_unlock();
 }
 
 int ath_rx_subframe(struct ath_node *an,
@@ -1293,6 +1323,8 @@ static int ath_detach(struct ath_softc *sc)
 	ath_rx_cleanup(sc);
 	ath_tx_cleanup(sc);
 
+	ath9k_exit_debug(sc);
+
 	/* Deinit */
 
 	ath_deinit(sc);
@@ -1304,7 +1336,7 @@ static int ath_attach(u_int16_t devid,
 		      struct ath_softc *sc)
 {
 	struct ieee80211_hw *hw = sc->hw;
-	int error = 0;
+	int error = 0, i;
 
 	DPRINTF(sc, ATH_DEBUG_CONFIG, "%s: Attach ATH hw\n", __func__);
 
@@ -1315,6 +1347,8 @@ static int ath_attach(u_int16_t devid,
 	/* Init nodes */
 
 	INIT_LIST_HEAD(&sc->node_list);
+	for (i = 0; i < ATH_NODE_HASHSIZE; i++)
+		INIT_HLIST_HEAD(&sc->sc_nodehash[i]);
 	spin_lock_init(&sc->node_lock);
 
 	/* get mac address from hardware and set in mac80211 */
@@ -1384,6 +1418,9 @@ static int ath_attach(u_int16_t devid,
 	if (error != 0)
 		goto bad1;
 
+	if (ath9k_init_debug(sc) < 0)
+		printk(KERN_ERR "ath9k: Unable to create debugfs files\n");
+
 	return 0;
 bad1:
 	ath_detach(sc);
@@ -1506,6 +1543,9 @@ static int ath_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 		goto bad4;
 	}
 
+	/* the chip model raises its interrupts through the same handler */
+	ath9k_hw_sim_setisr(sc->sc_ah, ath_isr, sc);
+
 	athname = ath9k_hw_probe(id->vendor, id->device);
 
 	printk(KERN_INFO "%s: %s: mem=0x%lx, irq=%d\n",
@@ -1532,6 +1572,7 @@ static void ath_pci_remove(struct pci_dev *pdev)
 	struct ieee80211_hw *hw = pci_get_drvdata(pdev);
 	struct ath_softc *sc = hw->priv;
 
+	ath9k_hw_sim_setisr(sc->sc_ah, NULL, NULL);
 	if (pdev->irq)
 		free_irq(pdev->irq, sc);
 	ath_detach(sc);
@@ -1592,10 +1633,14 @@ static int __init init_ath_pci(void)
 {
 	printk(KERN_INFO "%s: %s\n", dev_info, ATH_PCI_VERSION);
 
+	if (ath9k_debug_create_root() < 0)
+		printk(KERN_ERR "ath9k: Unable to create debugfs root\n");
+
 	if (pci_register_driver(&ath_pci_driver) < 0) {
 		printk(KERN_ERR
 			"ath_pci: No devices found, driver not installed.\n");
 		pci_unregister_driver(&ath_pci_driver);
+		ath9k_debug_remove_root();
 		return -ENODEV;
 	}
 
@@ -1606,6 +1651,9 @@ module_init(init_ath_pci);
 static void __exit exit_ath_pci(void)
 {
 	pci_unregister_driver(&ath_pci_driver);
+	/* wait for nodes still queued for an rcu free */
+	rcu_barrier();
+	ath9k_debug_remove_root();
 	printk(KERN_INFO "%s: driver unloaded\n", dev_info);
 }
 module_exit(exit_ath_pci);
@@ -28,7 +28,8 @@
  * buffer (or rx fifo). This can incorrectly acknowledge packets
  * to a sender if last desc is self-linked.
  *
- * NOTE: Caller should hold the rxbuf lock.
+ * NOTE: Caller should hold the rxbuf lock and kick the DMA engine
+ * with ath9k_hw_rxena() once it is done linking.
  */
 
 static void ath_rx_buf_link(struct ath_softc *sc, struct ath_buf *bf)
@@ -49,10 +50,10 @@ static void ath_rx_buf_link(struct ath_softc *sc, struct ath_buf *bf)
 	ASSERT(skb != NULL);
 	ds->ds_vdata = skb->data;
 
-	/* setup rx descriptors */
+	/* setup rx descriptors, the size is what ath_rxbuf_map() covers */
 	ath9k_hw_setuprxdesc(ah,
 			     ds,
-			     skb_tailroom(skb),   /* buffer size */
+			     sc->sc_rxbufsize,   /* buffer size */
 			     0);
 
 	if (sc->sc_rxlink == NULL)
@@ -61,7 +62,295 @@ static void ath_rx_buf_link(struct ath_softc *sc, struct ath_buf *bf)
 		*sc->sc_rxlink = bf->bf_daddr;
 
 	sc->sc_rxlink = &ds->ds_link;
-	ath9k_hw_rxena(ah);
+}
+
+/*
+ * Collect up to max completed buffers from the head of the rx ring.
+ *
+ * The hardware walks the ring in order, so completion is checked from
+ * sc_rxhead forward and stops at the first buffer still in progress.
+ * The holding descriptor and the buffers collected in this call are
+ * not on the h/w chain, which bounds a batch well below the ring size.
+ *
+ * NOTE: Caller should hold the rxbuf lock.
+ */
+
+static int ath_rx_harvest(struct ath_softc *sc,
+			  struct ath_buf **batch,
+			  int max)
+{
+#define PA2DESC(_sc, _pa)                                               \
+	((struct ath_desc *)((caddr_t)(_sc)->sc_rxdma.dd_desc +		\
+			     ((_pa) - (_sc)->sc_rxdma.dd_desc_paddr)))
+	struct ath_hal *ah = sc->sc_ah;
+	struct ath_buf *bf, *tbf;
+	struct ath_desc *ds, *tds;
+	enum hal_status retval;
+	int n;
+
+	if (sc->sc_rxlink == NULL)
+		return 0;
+
+	for (n = 0; n < max; n++) {
+		bf = &sc->sc_rxring[sc->sc_rxhead];
+		ds = bf->bf_desc;
+
+		/* wrapped around to the holding descriptor */
+		if (bf == sc->sc_rxheld)
+			break;
+
+		tbf = &sc->sc_rxring[(sc->sc_rxhead + 1) % sc->sc_rxnbuf];
+		prefetch(tbf->bf_desc);
+
+		/*
+		 * Must provide the virtual address of the current
+		 * descriptor, the physical address, and the virtual
+		 * address of the next descriptor in the h/w chain.
+		 * This allows the HAL to look ahead to see if the
+		 * hardware is done with a descriptor by checking the
+		 * done bit in the following descriptor and the address
+		 * of the current descriptor the DMA engine is working
+		 * on.  All this is necessary because of our use of
+		 * a self-linked list to avoid rx overruns.
+		 */
+		retval = ath9k_hw_rxprocdesc(ah,
+					     ds,
+					     bf->bf_daddr,
+					     PA2DESC(sc, ds->ds_link),
+					     0);
+		if (HAL_EINPROGRESS == retval) {
+			/*
+			 * On some hardware the descriptor status words could
+			 * get corrupted, including the done bit. Because of
+			 * this, check if the next descriptor's done bit is
+			 * set or not.
+			 *
+			 * If the next descriptor's done bit is set, the current
+			 * descriptor has been corrupted. Force s/w to discard
+			 * this descriptor and continue...
+			 */
+			if (ds->ds_link == 0 || tbf == sc->sc_rxheld)
+				break;
+
+			tds = tbf->bf_desc;
+
+			retval = ath9k_hw_rxprocdesc(ah,
+				tds, tbf->bf_daddr,
+				PA2DESC(sc, tds->ds_link), 0);
+			if (HAL_EINPROGRESS == retval)
+				break;
+		}
+
+		batch[n] = bf;
+		sc->sc_rxhead = (sc->sc_rxhead + 1) % sc->sc_rxnbuf;
+	}
+
+	return n;
+#undef PA2DESC
+}
+
+/*
+ * Give a processed batch back to the hardware.
+ *
+ * There is a race condition that BH gets scheduled after sw writes
+ * RxE and before hw re-load the last descriptor to get the newly
+ * chained one. Software must keep the last DONE descriptor as a
+ * holding descriptor: the previous one is relinked now, the last
+ * buffer of this batch is held until the next batch completes.
+ *
+ * NOTE: Caller should hold the rxbuf lock.
+ */
+
+static void ath_rx_relink(struct ath_softc *sc,
+			  struct ath_buf **batch,
+			  int n)
+{
+	int i;
+
+	if (sc->sc_rxheld != NULL)
+		ath_rx_buf_link(sc, sc->sc_rxheld);
+
+	for (i = 0; i < n - 1; i++)
+		ath_rx_buf_link(sc, batch[i]);
+
+	sc->sc_rxheld = batch[n - 1];
+	ath9k_hw_rxena(sc->sc_ah);
+}
+
+/*
+ * Rx reorder release engine
+ *
+ * A tid that holds subframes behind a hole sits on sc_rxreorder,
+ * ordered by the time the first held subframe is due to be released.
+ * One device timer is armed for the head of that list, and the rx
+ * tasklet also releases whatever is due, so a busy device flushes
+ * without timer interrupts. Lock order is tidlock, then the list lock.
+ */
+
+/* Pass the frame at the window head up, if any, and advance the window */
+
+static void ath_rx_reorder_pop(struct ath_arx_tid *rxtid)
+{
+	struct ath_rxbuf *rxbuf = rxtid->rxbuf + rxtid->baw_head;
+
+	if (rxbuf->rx_wbuf != NULL) {
+		__clear_bit(rxtid->baw_head, rxtid->held);
+		ath9k_debug_rxhold(rxtid->an->an_sc, rxbuf);
+		ath_rx_subframe(rxtid->an, rxbuf->rx_wbuf, &rxbuf->rx_status);
+		rxbuf->rx_wbuf = NULL;
+	}
+
+	INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
+	INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
+}
+
+/*
+ * Pass up the run of frames held in order at the window head. The run
+ * is found from the occupancy bitmap in one go rather than by testing
+ * slot by slot. The window is never as large as the ring, so the ring
+ * always has a hole to stop on.
+ */
+
+static int ath_rx_reorder_run(struct ath_arx_tid *rxtid)
+{
+	int head = rxtid->baw_head, n, i;
+
+	n = find_next_zero_bit(rxtid->held, ATH_TID_MAX_BUFS, head) - head;
+	if (head + n == ATH_TID_MAX_BUFS)
+		n += find_first_zero_bit(rxtid->held, head);
+
+	for (i = 0; i < n; i++)
+		ath_rx_reorder_pop(rxtid);
+
+	if (n)
+		ath9k_debug_rxrun(rxtid->an->an_sc, n);
+	return n;
+}
+
+/*
+ * First subframe held in the window, the one waiting on a hole. Slots
+ * outside the window are always empty, so any bit set is in it.
+ */
+
+static struct ath_rxbuf *ath_rx_reorder_first(struct ath_arx_tid *rxtid)
+{
+	int i;
+
+	i = find_next_bit(rxtid->held, ATH_TID_MAX_BUFS, rxtid->baw_head);
+	if (i == ATH_TID_MAX_BUFS)
+		i = find_first_bit(rxtid->held, ATH_TID_MAX_BUFS);
+
+	return i < ATH_TID_MAX_BUFS ? &rxtid->rxbuf[i] : NULL;
+}
+
+/*
+ * (Re)queue a tid by the release time of its first held subframe, or
+ * take it off the list when nothing is held.
+ * NB: must be called with tidlock held
+ */
+
+static void ath_rx_reorder_sched(struct ath_softc *sc,
+				 struct ath_arx_tid *rxtid)
+{
+	struct ath_arx_tid *pos;
+	struct ath_rxbuf *rxbuf = NULL;
+	unsigned long expire;
+
+	if (rxtid->addba_exchangecomplete)
+		rxbuf = ath_rx_reorder_first(rxtid);
+
+	spin_lock(&sc->sc_rxreorder_lock);
+	if (rxbuf == NULL) {
+		list_del_init(&rxtid->reorder);
+		goto unlock;
+	}
+
+	expire = rxbuf->rx_time + msecs_to_jiffies(ATH_RX_TIMEOUT);
+	if (!list_empty(&rxtid->reorder) && rxtid->expire == expire)
+		goto unlock;
+
+	/* new deadlines are nearly always the latest, search from the tail */
+	list_del(&rxtid->reorder);
+	rxtid->expire = expire;
+	list_for_each_entry_reverse(pos, &sc->sc_rxreorder, reorder) {
+		if (!time_after(pos->expire, expire))
+			break;
+	}
+	list_add(&rxtid->reorder, &pos->reorder);
+
+	if (sc->sc_rxreorder.next == &rxtid->reorder)
+		mod_timer(&sc->sc_rxreorder_timer, expire);
+unlock:
+	spin_unlock(&sc->sc_rxreorder_lock);
+}
+
+/*
+ * Give up on the holes in front of subframes that have waited out
+ * ATH_RX_TIMEOUT, and pass up everything in order behind them.
+ * NB: must be called with tidlock held
+ */
+
+static void ath_rx_reorder_flush(struct ath_arx_tid *rxtid)
+{
+	struct ath_rxbuf *rxbuf;
+
+	while ((rxbuf = ath_rx_reorder_first(rxtid)) != NULL) {
+		if (rxbuf != rxtid->rxbuf + rxtid->baw_head) {
+			if (time_before(jiffies, rxbuf->rx_time +
+					msecs_to_jiffies(ATH_RX_TIMEOUT)))
+				break;
+			ath9k_debug_rxtimeout(rxtid->an->an_sc);
+		}
+
+		/* skip the holes, then release the run behind them */
+		while (rxtid->rxbuf + rxtid->baw_head != rxbuf)
+			ath_rx_reorder_pop(rxtid);
+		ath_rx_reorder_run(rxtid);
+	}
+}
+
+/*
+ * Release every tid whose first held subframe is due.
+ *
+ * Tids are reached through the list, not the node hash. The read lock
+ * only keeps a node valid because ath_node_detach() takes its tids off
+ * the list before call_rcu(): a tid still listed when we find it has
+ * a node whose call_rcu() comes after our read side began. Unlinking
+ * any later than that breaks this.
+ */
+
+static void ath_rx_reorder_release(struct ath_softc *sc)
+{
+	struct ath_arx_tid *rxtid;
+
+	rcu_read_lock();
+	spin_lock_bh(&sc->sc_rxreorder_lock);
+	while (!list_empty(&sc->sc_rxreorder)) {
+		rxtid = list_first_entry(&sc->sc_rxreorder,
+					 struct ath_arx_tid, reorder);
+		if (time_before(jiffies, rxtid->expire)) {
+			mod_timer(&sc->sc_rxreorder_timer, rxtid->expire);
+			break;
+		}
+		list_del_init(&rxtid->reorder);
+		spin_unlock_bh(&sc->sc_rxreorder_lock);
+
+		spin_lock_bh(&rxtid->tidlock);
+		if (rxtid->addba_exchangecomplete) {
+			ath_rx_reorder_flush(rxtid);
+			ath_rx_reorder_sched(sc, rxtid);
+		}
+		spin_unlock_bh(&rxtid->tidlock);
+
+		spin_lock_bh(&sc->sc_rxreorder_lock);
+	}
+	spin_unlock_bh(&sc->sc_rxreorder_lock);
+	rcu_read_unlock();
+}
+
+static void ath_rx_reorder_timer(unsigned long data)
+{
+	ath_rx_reorder_release((struct ath_softc *)data);
 }
 
 /* Process received BAR frame */
@@ -72,8 +361,6 @@ static int ath_bar_rx(struct ath_softc *sc,
 {
 	struct ieee80211_bar *bar;
 	struct ath_arx_tid *rxtid;
-	struct sk_buff *tskb;
-	struct ath_recv_status *rx_status;
 	int tidno, index, cindex;
 	u_int16_t seqno;
 
@@ -105,31 +392,14 @@ static int ath_bar_rx(struct ath_softc *sc,
 
 	cindex = (rxtid->baw_head + index) & (ATH_TID_MAX_BUFS - 1);
 	while ((rxtid->baw_head != rxtid->baw_tail) &&
-	       (rxtid->baw_head != cindex)) {
-		tskb = rxtid->rxbuf[rxtid->baw_head].rx_wbuf;
-		rx_status = &rxtid->rxbuf[rxtid->baw_head].rx_status;
-		rxtid->rxbuf[rxtid->baw_head].rx_wbuf = NULL;
-
-		if (tskb != NULL)
-			ath_rx_subframe(an, tskb, rx_status);
-
-		INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
-		INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
-	}
+	       (rxtid->baw_head != cindex))
+		ath_rx_reorder_pop(rxtid);
 
 	/* ... and indicate rest of the frames in-order */
 
-	while (rxtid->baw_head != rxtid->baw_tail &&
-	       rxtid->rxbuf[rxtid->baw_head].rx_wbuf != NULL) {
-		tskb = rxtid->rxbuf[rxtid->baw_head].rx_wbuf;
-		rx_status = &rxtid->rxbuf[rxtid->baw_head].rx_status;
-		rxtid->rxbuf[rxtid->baw_head].rx_wbuf = NULL;
+	ath_rx_reorder_run(rxtid);
 
-		ath_rx_subframe(an, tskb, rx_status);
-
-		INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
-		INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
-	}
+	ath_rx_reorder_sched(sc, rxtid);
 
 unlock_and_free:
 	spin_unlock_bh(&rxtid->tidlock);
@@ -235,18 +505,7 @@ static int ath_ampdu_input(struct ath_softc *sc,
 		/* complete receive processing for all pending frames */
 
 		while (index >= rxtid->baw_size) {
-
-			rxbuf = rxtid->rxbuf + rxtid->baw_head;
-
-			if (rxbuf->rx_wbuf != NULL) {
-				ath_rx_subframe(an, rxbuf->rx_wbuf,
-						&rxbuf->rx_status);
-				rxbuf->rx_wbuf = NULL;
-			}
-
-			INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
-			INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
-
+			ath_rx_reorder_pop(rxtid);
 			index--;
 		}
 	}
@@ -264,8 +523,10 @@ static int ath_ampdu_input(struct ath_softc *sc,
 	}
 
 	rxbuf->rx_wbuf = skb;
-	rxbuf->rx_time = get_timestamp();
+	__set_bit(cindex, rxtid->held);
+	rxbuf->rx_time = jiffies;
 	rxbuf->rx_status = *rx_status;
+	ath9k_debug_rxhold_stamp(rxbuf);
 
 	/* advance tail if sequence received is newer
 	 * than any received so far */
@@ -277,84 +538,19 @@ static int ath_ampdu_input(struct ath_softc *sc,
 
 	/* indicate all in-order received frames */
 
-	while (rxtid->baw_head != rxtid->baw_tail) {
-		rxbuf = rxtid->rxbuf + rxtid->baw_head;
-		if (!rxbuf->rx_wbuf)
-			break;
-
-		ath_rx_subframe(an, rxbuf->rx_wbuf, &rxbuf->rx_status);
-		rxbuf->rx_wbuf = NULL;
+	ath_rx_reorder_run(rxtid);
 
-		INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
-		INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
-	}
-
-	/*
-	 * start a timer to flush all received frames if there are pending
-	 * receive frames
-	 */
-	if (rxtid->baw_head != rxtid->baw_tail)
-		mod_timer(&rxtid->timer, ATH_RX_TIMEOUT);
-	else
-		del_timer_sync(&rxtid->timer);
+	/* hand anything still held behind a hole to the release engine */
+	ath_rx_reorder_sched(sc, rxtid);
 
 	spin_unlock(&rxtid->tidlock);
 	return IEEE80211_FTYPE_DATA;
 }
 
-/* Timer to flush all received sub-frames */
-
-static void ath_rx_timer(unsigned long data)
-{
-	struct ath_arx_tid *rxtid = (struct ath_arx_tid *)data;
-	struct ath_node *an = rxtid->an;
-	struct ath_rxbuf *rxbuf;
-	int nosched;
-
-	spin_lock_bh(&rxtid->tidlock);
-	while (rxtid->baw_head != rxtid->baw_tail) {
-		rxbuf = rxtid->rxbuf + rxtid->baw_head;
-		if (!rxbuf->rx_wbuf) {
-			INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
-			INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
-			continue;
-		}
-
-		/*
-		 * Stop if the next one is a very recent frame.
-		 *
-		 * Call get_timestamp in every iteration to protect against the
-		 * case in which a new frame is received while we are executing
-		 * this function. Using a timestamp obtained before entering
-		 * the loop could lead to a very large time interval
-		 * (a negative value typecast to unsigned), breaking the
-		 * function's logic.
-		 */
-		if ((get_timestamp() - rxbuf->rx_time) <
-			(ATH_RX_TIMEOUT * HZ / 1000))
-			break;
-
-		ath_rx_subframe(an, rxbuf->rx_wbuf,
-				&rxbuf->rx_status);
-		rxbuf->rx_wbuf = NULL;
-
-		INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
-		INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
-	}
-
-	/*
-	 * start a timer to flush all received frames if there are pending
-	 * receive frames
-	 */
-	if (rxtid->baw_head != rxtid->baw_tail)
-		nosched = 0;
-	else
-		nosched = 1; /* no need to re-arm the timer again */
-
-	spin_unlock_bh(&rxtid->tidlock);
-}
-
-/* Free all pending sub-frames in the re-ordering buffer */
+/*
+ * Free all pending sub-frames in the re-ordering buffer and stop
+ * reordering on this tid
+ */
 
 static void ath_rx_flush_tid(struct ath_softc *sc,
 	struct ath_arx_tid *rxtid, int drop)
@@ -362,6 +558,9 @@ static void ath_rx_flush_tid(struct ath_softc *sc,
 	struct ath_rxbuf *rxbuf;
 
 	spin_lock_bh(&rxtid->tidlock);
+	rxtid->addba_exchangecomplete = 0;
+	ath_rx_reorder_sched(sc, rxtid);
+
 	while (rxtid->baw_head != rxtid->baw_tail) {
 		rxbuf = rxtid->rxbuf + rxtid->baw_head;
 		if (!rxbuf->rx_wbuf) {
@@ -382,6 +581,7 @@ static void ath_rx_flush_tid(struct ath_softc *sc,
 		INCR(rxtid->baw_head, ATH_TID_MAX_BUFS);
 		INCR(rxtid->seq_next, IEEE80211_SEQ_MAX);
 	}
+	bitmap_zero(rxtid->held, ATH_TID_MAX_BUFS);
 	spin_unlock_bh(&rxtid->tidlock);
 }
 
@@ -466,60 +666,174 @@ static struct sk_buff *ath_rxbuf_alloc(struct ath_softc *sc,
 	return skb;
 }
 
-static void ath_rx_requeue(struct ath_softc *sc, struct sk_buff *skb)
+/*
+ * Rx buffer recycling.
+ *
+ * A received frame goes up the stack as a clone of the ring skb, the
+ * ring skb itself stays mapped and is parked on sc_rxlent. Once the
+ * stack frees the clone the data is ours again (the skb is no longer
+ * cloned) and the buffer refills a ring slot without an allocation or
+ * a new mapping. Lent buffers are checked oldest first, and ones still
+ * cloned (e.g. held for reorder) are moved to the tail. A buffer is
+ * never unmapped while a clone may still read it: when the list is
+ * full and every entry is still out, the new frame goes up without a
+ * clone instead.
+ *
+ * NOTE: only the rx tasklet and init/cleanup touch sc_rxlent.
+ */
+
+static dma_addr_t ath_rxbuf_map(struct ath_softc *sc, struct sk_buff *skb)
+{
+	return pci_map_single(sc->pdev, skb->data, sc->sc_rxbufsize,
+			      PCI_DMA_FROMDEVICE);
+}
+
+/*
+ * Take the oldest lent buffer the stack is done with off the list,
+ * rotating the ones still cloned to the tail.
+ */
+static struct ath_rxlent *ath_rxbuf_reclaim(struct ath_softc *sc)
+{
+	struct ath_rxlent *rl;
+	int n;
+
+	for (n = sc->sc_nrxlent; n > 0; n--) {
+		rl = &sc->sc_rxlent[sc->sc_rxlenthead];
+		sc->sc_rxlenthead = (sc->sc_rxlenthead + 1) % ATH_RX_RECYCLE;
+		if (!skb_cloned(rl->skb)) {
+			sc->sc_nrxlent--;
+			return rl;
+		}
+		sc->sc_rxlent[(sc->sc_rxlenthead + sc->sc_nrxlent - 1) %
+			      ATH_RX_RECYCLE] = *rl;
+	}
+	return NULL;
+}
+
+/* Park a buffer whose clone went up, 0 when there is no room */
+static int ath_rxbuf_lend(struct ath_softc *sc, struct sk_buff *skb,
+			  dma_addr_t pa)
 {
-	struct ath_buf *bf = ATH_RX_CONTEXT(skb)->ctx_rxbuf;
+	struct ath_rxlent *rl;
 
-	ASSERT(bf != NULL);
+	if (sc->sc_nrxlent == ATH_RX_RECYCLE) {
+		rl = ath_rxbuf_reclaim(sc);
+		if (rl == NULL)
+			return 0;
+		pci_unmap_single(sc->pdev, rl->pa, sc->sc_rxbufsize,
+				 PCI_DMA_FROMDEVICE);
+		dev_kfree_skb_any(rl->skb);
+	}
 
-	spin_lock_bh(&sc->sc_rxbuflock);
-	if (bf->bf_status & ATH_BUFSTATUS_STALE) {
-		/*
-		 * This buffer is still held for hw acess.
-		 * Mark it as free to be re-queued it later.
-		 */
-		bf->bf_status |= ATH_BUFSTATUS_FREE;
-	} else {
-		/* XXX: we probably never enter here, remove after
-		 * verification */
-		list_add_tail(&bf->list, &sc->sc_rxbuf);
-		ath_rx_buf_link(sc, bf);
+	rl = &sc->sc_rxlent[(sc->sc_rxlenthead + sc->sc_nrxlent) %
+			    ATH_RX_RECYCLE];
+	rl->skb = skb;
+	rl->pa = pa;
+	rl->len = skb->len;
+	sc->sc_nrxlent++;
+
+	/* the clone carries the frame, keep this one empty for reuse */
+	skb_trim(skb, 0);
+	return 1;
+}
+
+/* Get a mapped buffer for a ring slot, recycled when possible */
+
+static struct sk_buff *ath_rxbuf_get(struct ath_softc *sc, dma_addr_t *pa)
+{
+	struct ath_rxlent *rl;
+	struct sk_buff *skb;
+
+	rl = ath_rxbuf_reclaim(sc);
+	if (rl != NULL) {
+		skb = rl->skb;
+		*pa = rl->pa;
+		/* hand back the lines the stack may have written */
+		if (rl->len)
+			pci_dma_sync_single_for_device(sc->pdev, rl->pa,
+						       rl->len,
+						       PCI_DMA_FROMDEVICE);
+		ath9k_debug_rxbuf(sc, 1);
+		return skb;
 	}
-	spin_unlock_bh(&sc->sc_rxbuflock);
+
+	skb = ath_rxbuf_alloc(sc, sc->sc_rxbufsize);
+	if (skb == NULL)
+		return NULL;
+	*pa = ath_rxbuf_map(sc, skb);
+	ath9k_debug_rxbuf(sc, 0);
+	return skb;
+}
+
+/* Queue a frame to be handed up with the rest of the batch */
+
+static void ath_rx_queue(struct ath_softc *sc,
+			 struct sk_buff *skb,
+			 struct ath_recv_status *status,
+			 u_int16_t keyix)
+{
+	struct ath_rx_pending *rxp = &sc->sc_rxpend[sc->sc_nrxpend++];
+
+	rxp->skb = skb;
+	rxp->status = *status;
+	rxp->keyix = keyix;
 }
 
 /*
- * The skb indicated to upper stack won't be returned to us.
- * So we have to allocate a new one and queue it by ourselves.
+ * Copy-break: a short frame is copied into a right-sized skb and its
+ * ring buffer stays in the slot, still mapped, to be relinked as is.
+ * Keeps the truesize of ACKs and other small frames honest for socket
+ * accounting and saves a buffer turnover.
  */
-static int ath_rx_indicate(struct ath_softc *sc,
-			   struct sk_buff *skb,
-			   struct ath_recv_status *status,
-			   u_int16_t keyix)
+
+static struct sk_buff *ath_rx_copy(struct ath_softc *sc,
+				   struct sk_buff *skb,
+				   u_int32_t len)
 {
-	struct ath_buf *bf = ATH_RX_CONTEXT(skb)->ctx_rxbuf;
-	struct sk_buff *nskb;
-	int type;
-
-	/* indicate frame to the stack, which will free the old skb. */
-	type = ath__rx_indicate(sc, skb, status, keyix);
-
-	/* allocate a new skb and queue it to for H/W processing */
-	nskb = ath_rxbuf_alloc(sc, sc->sc_rxbufsize);
-	if (nskb != NULL) {
-		bf->bf_mpdu = nskb;
-		bf->bf_buf_addr = ath_skb_map_single(sc,
-			nskb,
-			PCI_DMA_FROMDEVICE,
-			/* XXX: Remove get_dma_mem_context() */
-			get_dma_mem_context(bf, bf_dmacontext));
-		ATH_RX_CONTEXT(nskb)->ctx_rxbuf = bf;
-
-		/* queue the new wbuf to H/W */
-		ath_rx_requeue(sc, nskb);
+	struct sk_buff *cskb;
+
+	cskb = dev_alloc_skb(len);
+	if (cskb == NULL)
+		return NULL;
+
+	memcpy(skb_put(cskb, len), skb->data, len);
+	ath9k_debug_rxcopy(sc, len);
+	return cskb;
+}
+
+/*
+ * Queue a ring buffer's frame. The stack gets a clone and the buffer
+ * is lent out until the clone is freed; the slot takes over the
+ * replacement the caller got from ath_rxbuf_get() and is relinked
+ * with it at the end of the batch.
+ */
+static void ath_rx_indicate(struct ath_softc *sc,
+			    struct ath_buf *bf,
+			    struct sk_buff *nskb,
+			    dma_addr_t pa,
+			    struct ath_recv_status *status,
+			    u_int16_t keyix)
+{
+	struct sk_buff *skb = bf->bf_mpdu;
+	struct sk_buff *cskb;
+
+	cskb = skb_clone(skb, GFP_ATOMIC);
+	if (cskb != NULL && !ath_rxbuf_lend(sc, skb, bf->bf_buf_addr)) {
+		/* every lent buffer is still up the stack */
+		dev_kfree_skb_any(cskb);
+		cskb = NULL;
 	}
+	if (cskb == NULL) {
+		/* no clone, the buffer itself goes up and is not recycled */
+		pci_unmap_single(sc->pdev, bf->bf_buf_addr, sc->sc_rxbufsize,
+				 PCI_DMA_FROMDEVICE);
+		cskb = skb;
+	}
+	ath_rx_queue(sc, cskb, status, keyix);
 
-	return type;
+	bf->bf_mpdu = nskb;
+	bf->bf_buf_addr = pa;
+	bf->bf_dmacontext = pa;
 }
 
 static void ath_opmode_init(struct ath_softc *sc)
@@ -560,6 +874,10 @@ int ath_rx_init(struct ath_softc *sc, int nbufs)
 		spin_lock_init(&sc->sc_rxflushlock);
 		sc->sc_rxflush = 0;
 		spin_lock_init(&sc->sc_rxbuflock);
+		INIT_LIST_HEAD(&sc->sc_rxreorder);
+		spin_lock_init(&sc->sc_rxreorder_lock);
+		setup_timer(&sc->sc_rxreorder_timer, ath_rx_reorder_timer,
+			    (unsigned long)sc);
 
 		/*
 		 * Cisco's VPN software requires that drivers be able to
@@ -595,13 +913,20 @@ int ath_rx_init(struct ath_softc *sc, int nbufs)
 			}
 
 			bf->bf_mpdu = skb;
-			bf->bf_buf_addr =
-				ath_skb_map_single(sc, skb, PCI_DMA_FROMDEVICE,
-				       get_dma_mem_context(bf, bf_dmacontext));
-			ATH_RX_CONTEXT(skb)->ctx_rxbuf = bf;
+			bf->bf_buf_addr = ath_rxbuf_map(sc, skb);
+			bf->bf_dmacontext = bf->bf_buf_addr;
+			ath9k_debug_rxbuf(sc, 0);
 		}
 		sc->sc_rxlink = NULL;
 
+		/* ath_descdma_setup lays the buffers out as an array */
+		sc->sc_rxring = sc->sc_rxdma.dd_bufptr;
+		sc->sc_rxnbuf = nbufs;
+		sc->sc_rxhead = 0;
+		sc->sc_rxheld = NULL;
+		sc->sc_rxlenthead = 0;
+		sc->sc_nrxlent = 0;
+
 	} while (0);
 
 	if (error)
@@ -614,13 +939,28 @@ int ath_rx_init(struct ath_softc *sc, int nbufs)
 
 void ath_rx_cleanup(struct ath_softc *sc)
 {
+	struct ath_rxlent *rl;
 	struct sk_buff *skb;
 	struct ath_buf *bf;
 
+	del_timer_sync(&sc->sc_rxreorder_timer);
+
 	list_for_each_entry(bf, &sc->sc_rxbuf, list) {
 		skb = bf->bf_mpdu;
-		if (skb)
+		if (skb) {
+			pci_unmap_single(sc->pdev, bf->bf_buf_addr,
+					 sc->sc_rxbufsize, PCI_DMA_FROMDEVICE);
 			dev_kfree_skb(skb);
+		}
+	}
+
+	/* buffers still lent out, the stack keeps its clones */
+	for (; sc->sc_nrxlent; sc->sc_nrxlent--) {
+		rl = &sc->sc_rxlent[sc->sc_rxlenthead];
+		pci_unmap_single(sc->pdev, rl->pa, sc->sc_rxbufsize,
+				 PCI_DMA_FROMDEVICE);
+		dev_kfree_skb(rl->skb);
+		sc->sc_rxlenthead = (sc->sc_rxlenthead + 1) % ATH_RX_RECYCLE;
 	}
 
 	/* cleanup rx descriptors */
@@ -685,37 +1025,24 @@ u_int32_t ath_calcrxfilter(struct ath_softc *sc)
 int ath_startrecv(struct ath_softc *sc)
 {
 	struct ath_hal *ah = sc->sc_ah;
-	struct ath_buf *bf, *tbf;
+	struct ath_buf *bf;
+	int i;
 
 	spin_lock_bh(&sc->sc_rxbuflock);
-	if (list_empty(&sc->sc_rxbuf))
+	if (sc->sc_rxnbuf == 0)
 		goto start_recv;
 
+	/*
+	 * restarting h/w, no need for a holding descriptor: chain the
+	 * whole ring again, in order, starting from the head
+	 */
 	sc->sc_rxlink = NULL;
-	list_for_each_entry_safe(bf, tbf, &sc->sc_rxbuf, list) {
-		if (bf->bf_status & ATH_BUFSTATUS_STALE) {
-			/* restarting h/w, no need for holding descriptors */
-			bf->bf_status &= ~ATH_BUFSTATUS_STALE;
-			/*
-			 * Upper layer may not be done with the frame yet so
-			 * we can't just re-queue it to hardware. Remove it
-			 * from h/w queue. It'll be re-queued when upper layer
-			 * returns the frame and ath_rx_requeue_mpdu is called.
-			 */
-			if (!(bf->bf_status & ATH_BUFSTATUS_FREE)) {
-				list_del(&bf->list);
-				continue;
-			}
-		}
-		/* chain descriptors */
-		ath_rx_buf_link(sc, bf);
-	}
-
-	/* We could have deleted elements so the list may be empty now */
-	if (list_empty(&sc->sc_rxbuf))
-		goto start_recv;
+	sc->sc_rxheld = NULL;
+	for (i = 0; i < sc->sc_rxnbuf; i++)
+		ath_rx_buf_link(sc, &sc->sc_rxring[(sc->sc_rxhead + i) %
+						   sc->sc_rxnbuf]);
 
-	bf = list_first_entry(&sc->sc_rxbuf, struct ath_buf, list);
+	bf = &sc->sc_rxring[sc->sc_rxhead];
 	ath9k_hw_putrxbuf(ah, bf->bf_daddr);
 	ath9k_hw_rxena(ah);      /* enable recv descriptors */
 
@@ -758,7 +1085,7 @@ void ath_flushrecv(struct ath_softc *sc)
 	spin_lock_bh(&sc->sc_rxflushlock);
 	sc->sc_rxflush = 1;
 
-	ath_rx_tasklet(sc, 1);
+	ath_rx_tasklet(sc, 1, 0);
 
 	sc->sc_rxflush = 0;
 	spin_unlock_bh(&sc->sc_rxflushlock);
@@ -782,164 +1109,103 @@ int ath_rx_input(struct ath_softc *sc,
 	}
 }
 
-/* Process receive queue, as well as LED, etc. */
+/*
+ * Process receive queue, as well as LED, etc.
+ *
+ * At most 'budget' frames are taken off the ring, 0 means until it is
+ * empty. Returns the number of frames processed; a caller that gets
+ * back its full budget should assume more are waiting.
+ */
 
-int ath_rx_tasklet(struct ath_softc *sc, int flush)
+int ath_rx_tasklet(struct ath_softc *sc, int flush, int budget)
 {
-#define PA2DESC(_sc, _pa)                                               \
-	((struct ath_desc *)((caddr_t)(_sc)->sc_rxdma.dd_desc +		\
-			     ((_pa) - (_sc)->sc_rxdma.dd_desc_paddr)))
-
-	struct ath_buf *bf, *bf_held = NULL;
+	struct ath_buf *batch[ATH_RX_BATCH];
+	struct ath_buf *bf = NULL;
 	struct ath_desc *ds;
 	struct ieee80211_hdr *hdr;
-	struct sk_buff *skb = NULL;
+	struct sk_buff *skb = NULL, *nskb;
 	struct ath_recv_status rx_status;
-	struct ath_hal *ah = sc->sc_ah;
-	int type, rx_processed = 0;
+	dma_addr_t pa;
+	int nbatch = 0, i = 0, n, ndone = 0;
+	u_int32_t rxbytes = 0, synclen = 0;
+	cycles_t start = 0;
 	u_int phyerr;
 	u_int8_t rxchainmask, chainreset = 0;
-	enum hal_status retval;
 	__le16 fc;
 
 	DPRINTF(sc, ATH_DEBUG_RX_PROC, "%s\n", __func__);
 
-	do {
-		/* If handling rx interrupt and flush is in progress => exit */
-		if (sc->sc_rxflush && (flush == 0))
-			break;
-
-		spin_lock_bh(&sc->sc_rxbuflock);
-		if (list_empty(&sc->sc_rxbuf)) {
-			sc->sc_rxlink = NULL;
-			spin_unlock_bh(&sc->sc_rxbuflock);
-			break;
-		}
-
-		bf = list_first_entry(&sc->sc_rxbuf, struct ath_buf, list);
-
+	for (;;) {
 		/*
-		 * There is a race condition that BH gets scheduled after sw
-		 * writes RxE and before hw re-load the last descriptor to get
-		 * the newly chained one. Software must keep the last DONE
-		 * descriptor as a holding descriptor - software does so by
-		 * marking it with the STALE flag.
+		 * The previous buffer was synced for the cpu and, unless a
+		 * replacement took its slot, goes back to the h/w as it is.
 		 */
-		if (bf->bf_status & ATH_BUFSTATUS_STALE) {
-			bf_held = bf;
-			if (list_is_last(&bf_held->list, &sc->sc_rxbuf)) {
-				/*
-				 * The holding descriptor is the last
-				 * descriptor in queue. It's safe to
-				 * remove the last holding descriptor
-				 * in BH context.
-				 */
-				list_del(&bf_held->list);
-				bf_held->bf_status &= ~ATH_BUFSTATUS_STALE;
-				sc->sc_rxlink = NULL;
-
-				if (bf_held->bf_status & ATH_BUFSTATUS_FREE) {
-					list_add_tail(&bf_held->list,
-						&sc->sc_rxbuf);
-					ath_rx_buf_link(sc, bf_held);
-				}
-				spin_unlock_bh(&sc->sc_rxbuflock);
-				break;
-			}
-			bf = list_entry(bf->list.next, struct ath_buf, list);
+		if (synclen) {
+			pci_dma_sync_single_for_device(sc->pdev,
+						       bf->bf_buf_addr, synclen,
+						       PCI_DMA_FROMDEVICE);
+			synclen = 0;
 		}
 
-		ds = bf->bf_desc;
-		++rx_processed;
-
-		/*
-		 * Must provide the virtual address of the current
-		 * descriptor, the physical address, and the virtual
-		 * address of the next descriptor in the h/w chain.
-		 * This allows the HAL to look ahead to see if the
-		 * hardware is done with a descriptor by checking the
-		 * done bit in the following descriptor and the address
-		 * of the current descriptor the DMA engine is working
-		 * on.  All this is necessary because of our use of
-		 * a self-linked list to avoid rx overruns.
-		 */
-		retval = ath9k_hw_rxprocdesc(ah,
-					     ds,
-					     bf->bf_daddr,
-					     PA2DESC(sc, ds->ds_link),
-					     0);
-		if (HAL_EINPROGRESS == retval) {
-			struct ath_buf *tbf;
-			struct ath_desc *tds;
-
-			if (list_is_last(&bf->list, &sc->sc_rxbuf)) {
-				spin_unlock_bh(&sc->sc_rxbuflock);
-				break;
+		if (i == nbatch) {
+			/* pass the frames of this batch up to the stack */
+			if (sc->sc_nrxpend) {
+				ath__rx_indicate(sc, sc->sc_rxpend,
+						 sc->sc_nrxpend);
+				sc->sc_nrxpend = 0;
+			}
+			if (nbatch) {
+				if (!flush)
+					sc->sc_intrcoal.wframes += nbatch;
+				ath9k_debug_rx(sc, nbatch, rxbytes,
+					       ath9k_debug_cycles() - start);
 			}
-
-			tbf = list_entry(bf->list.next, struct ath_buf, list);
 
 			/*
-			 * On some hardware the descriptor status words could
-			 * get corrupted, including the done bit. Because of
-			 * this, check if the next descriptor's done bit is
-			 * set or not.
-			 *
-			 * If the next descriptor's done bit is set, the current
-			 * descriptor has been corrupted. Force s/w to discard
-			 * this descriptor and continue...
+			 * Batch done: give it back to the h/w and collect
+			 * the next one under a single rxbuf lock round-trip.
 			 */
+			spin_lock_bh(&sc->sc_rxbuflock);
+			if (nbatch)
+				ath_rx_relink(sc, batch, nbatch);
+			nbatch = i = 0;
+
+			/* If handling rx interrupt and flush is in progress
+			 * => exit */
+			n = ATH_RX_BATCH;
+			if (budget && budget - ndone < n)
+				n = budget - ndone;
+			if (n > 0 && (!sc->sc_rxflush || flush))
+				nbatch = ath_rx_harvest(sc, batch, n);
+			spin_unlock_bh(&sc->sc_rxbuflock);
 
-			tds = tbf->bf_desc;
-			retval = ath9k_hw_rxprocdesc(ah,
-				tds, tbf->bf_daddr,
-				PA2DESC(sc, tds->ds_link), 0);
-			if (HAL_EINPROGRESS == retval) {
-				spin_unlock_bh(&sc->sc_rxbuflock);
+			if (nbatch == 0)
 				break;
-			}
-		}
+			ndone += nbatch;
 
-		/* XXX: we do not support frames spanning
-		 * multiple descriptors */
-		bf->bf_status |= ATH_BUFSTATUS_DONE;
-
-		skb = bf->bf_mpdu;
-		if (skb == NULL) {		/* XXX ??? can this happen */
-			spin_unlock_bh(&sc->sc_rxbuflock);
-			continue;
-		}
-		/*
-		 * Now we know it's a completed frame, we can indicate the
-		 * frame. Remove the previous holding descriptor and leave
-		 * this one in the queue as the new holding descriptor.
-		 */
-		if (bf_held) {
-			list_del(&bf_held->list);
-			bf_held->bf_status &= ~ATH_BUFSTATUS_STALE;
-			if (bf_held->bf_status & ATH_BUFSTATUS_FREE) {
-				list_add_tail(&bf_held->list, &sc->sc_rxbuf);
-				/* try to requeue this descriptor */
-				ath_rx_buf_link(sc, bf_held);
-			}
+			start = ath9k_debug_cycles();
+			rxbytes = 0;
 		}
 
-		bf->bf_status |= ATH_BUFSTATUS_STALE;
-		bf_held = bf;
-		/*
-		 * Release the lock here in case ieee80211_input() return
-		 * the frame immediately by calling ath_rx_mpdu_requeue().
-		 */
-		spin_unlock_bh(&sc->sc_rxbuflock);
+		bf = batch[i++];
+		ds = bf->bf_desc;
+		skb = bf->bf_mpdu;
+		rxbytes += ds->ds_rxstat.rs_datalen;
 
 		if (flush) {
 			/*
 			 * If we're asked to flush receive queue, directly
 			 * chain it back at the queue without processing it.
 			 */
-			goto rx_next;
+			continue;
 		}
 
+		/* only the bytes the h/w wrote need to be synced */
+		synclen = min_t(u_int32_t, ds->ds_rxstat.rs_datalen,
+				sc->sc_rxbufsize);
+		pci_dma_sync_single_for_cpu(sc->pdev, bf->bf_buf_addr,
+					    synclen, PCI_DMA_FROMDEVICE);
+
 		hdr = (struct ieee80211_hdr *)skb->data;
 		fc = hdr->frame_control;
 		memzero(&rx_status, sizeof(struct ath_recv_status));
@@ -957,7 +1223,7 @@ int ath_rx_tasklet(struct ath_softc *sc, int flush)
 			 * error frames in Monitor mode.
 			 */
 			if (sc->sc_opmode != HAL_M_MONITOR)
-				goto rx_next;
+				continue;
 #endif
 			/* fall thru for monitor mode handling... */
 		} else if (ds->ds_rxstat.rs_status != 0) {
@@ -965,7 +1231,7 @@ int ath_rx_tasklet(struct ath_softc *sc, int flush)
 				rx_status.flags |= ATH_RX_FCS_ERROR;
 			if (ds->ds_rxstat.rs_status & HAL_RXERR_PHY) {
 				phyerr = ds->ds_rxstat.rs_phyerr & 0x1f;
-				goto rx_next;
+				continue;
 			}
 
 			if (ds->ds_rxstat.rs_status & HAL_RXERR_DECRYPT) {
@@ -1005,11 +1271,11 @@ int ath_rx_tasklet(struct ath_softc *sc, int flush)
 				if (ds->ds_rxstat.rs_status &
 				    ~(HAL_RXERR_DECRYPT | HAL_RXERR_MIC |
 					HAL_RXERR_CRC))
-					goto rx_next;
+					continue;
 			} else {
 				if (ds->ds_rxstat.rs_status &
 				    ~(HAL_RXERR_DECRYPT | HAL_RXERR_MIC)) {
-					goto rx_next;
+					continue;
 				}
 			}
 		}
@@ -1017,15 +1283,27 @@ int ath_rx_tasklet(struct ath_softc *sc, int flush)
 		 * The status portion of the descriptor could get corrupted.
 		 */
 		if (sc->sc_rxbufsize < ds->ds_rxstat.rs_datalen)
-			goto rx_next;
-		/*
-		 * Sync and unmap the frame.  At this point we're
-		 * committed to passing the sk_buff somewhere so
-		 * clear buf_skb; this means a new sk_buff must be
-		 * allocated when the rx descriptor is setup again
-		 * to receive another frame.
-		 */
-		skb_put(skb, ds->ds_rxstat.rs_datalen);
+			continue;
+		if (ds->ds_rxstat.rs_datalen < sc->sc_config.rx_copybreak) {
+			/*
+			 * Small frame, the ring buffer stays in place and is
+			 * synced back for the device before it is relinked.
+			 */
+			nskb = NULL;
+			skb = ath_rx_copy(sc, skb, ds->ds_rxstat.rs_datalen);
+			if (skb == NULL)
+				continue;
+		} else {
+			/*
+			 * Get the replacement before committing the frame:
+			 * when none is available the frame is dropped and
+			 * its buffer relinked, so the ring never runs short.
+			 */
+			nskb = ath_rxbuf_get(sc, &pa);
+			if (nskb == NULL)
+				continue;
+			skb_put(skb, ds->ds_rxstat.rs_datalen);
+		}
 		skb->protocol = ETH_P_CONTROL;
 		rx_status.tsf = ath_extend_tsf(sc, ds->ds_rxstat.rs_tstamp);
 		rx_status.rateieee =
@@ -1064,15 +1342,6 @@ int ath_rx_tasklet(struct ath_softc *sc, int flush)
 		rx_status.abs_rssi =
 			ds->ds_rxstat.rs_rssi + ATH_DEFAULT_NOISE_FLOOR;
 
-		pci_dma_sync_single_for_cpu(sc->pdev,
-					    bf->bf_buf_addr,
-					    skb_tailroom(skb),
-					    PCI_DMA_FROMDEVICE);
-		pci_unmap_single(sc->pdev,
-				 bf->bf_buf_addr,
-				 sc->sc_rxbufsize,
-				 PCI_DMA_FROMDEVICE);
-
 		/* XXX: Ah! make me more readable, use a helper */
 		if (sc->sc_hashtsupport) {
 			if (ds->ds_rxstat.rs_moreaggr == 0) {
@@ -1105,10 +1374,17 @@ int ath_rx_tasklet(struct ath_softc *sc, int flush)
 			rx_status.flags |= ATH_RX_RSSI_VALID;
 		}
 
-		/* Pass frames up to the stack. */
+		/* Queue the frame for the stack. */
 
-		type = ath_rx_indicate(sc, skb,
-			&rx_status, ds->ds_rxstat.rs_keyix);
+		if (nskb != NULL) {
+			ath_rx_indicate(sc, bf, nskb, pa,
+				&rx_status, ds->ds_rxstat.rs_keyix);
+			/* the slot has the replacement, already synced */
+			synclen = 0;
+		} else {
+			ath_rx_queue(sc, skb,
+				&rx_status, ds->ds_rxstat.rs_keyix);
+		}
 
 		if (sc->sc_diversity) {
 			/*
@@ -1149,17 +1425,11 @@ int ath_rx_tasklet(struct ath_softc *sc, int flush)
 			ath_slow_ant_div(&sc->sc_antdiv, hdr, &ds->ds_rxstat);
 		}
 #endif
-		/*
-		 * For frames successfully indicated, the buffer will be
-		 * returned to us by upper layers by calling
-		 * ath_rx_mpdu_requeue, either synchronusly or asynchronously.
-		 * So we don't want to do it here in this loop.
-		 */
-		continue;
+	}
 
-rx_next:
-		bf->bf_status |= ATH_BUFSTATUS_FREE;
-	} while (TRUE);
+	/* release subframes held past their time while we were busy */
+	if (sc->sc_rxaggr)
+		ath_rx_reorder_release(sc);
 
 	if (chainreset) {
 		DPRINTF(sc, ATH_DEBUG_CONFIG,
@@ -1169,8 +1439,7 @@ rx_next:
 		ath_internal_reset(sc);
 	}
 
-	return 0;
-#undef PA2DESC
+	return ndone;
 }
 
 /* Process ADDBA request in per-TID data structure */
@@ -1239,6 +1508,7 @@ int ath_rx_aggr_start(struct ath_softc *sc,
 			 * pointers are null) */
 			memzero(rxtid->rxbuf, ATH_TID_MAX_BUFS *
 				sizeof(struct ath_rxbuf));
+			bitmap_zero(rxtid->held, ATH_TID_MAX_BUFS);
 			DPRINTF(sc, ATH_DEBUG_AGGR,
 				"%s: Allocated @%p\n", __func__, rxtid->rxbuf);
 
@@ -1283,9 +1553,7 @@ void ath_rx_aggr_teardown(struct ath_softc *sc,
 	if (!rxtid->addba_exchangecomplete)
 		return;
 
-	del_timer_sync(&rxtid->timer);
 	ath_rx_flush_tid(sc, rxtid, 0);
-	rxtid->addba_exchangecomplete = 0;
 
 	/* De-allocate the receive buffer array allocated when addba started */
 
@@ -1324,8 +1592,7 @@ void ath_rx_node_init(struct ath_softc *sc, struct ath_node *an)
 			*/
 
 			rxtid->rxbuf     = NULL;
-			setup_timer(&rxtid->timer, ath_rx_timer,
-				(unsigned long)rxtid);
+			INIT_LIST_HEAD(&rxtid->reorder);
 			spin_lock_init(&rxtid->tidlock);
 
 			/* ADDBA state */
@@ -1334,6 +1601,30 @@ void ath_rx_node_init(struct ath_softc *sc, struct ath_node *an)
 	}
 }
 
+/*
+ * Stop reordering on a node being detached: no new subframe is held
+ * and every tid is off sc_rxreorder, so the release engine cannot
+ * reach the node once this returns. Held subframes stay until
+ * ath_rx_node_cleanup().
+ */
+
+void ath_rx_node_detach(struct ath_softc *sc, struct ath_node *an)
+{
+	if (sc->sc_rxaggr) {
+		struct ath_arx_tid *rxtid;
+		int tidno;
+
+		for (tidno = 0, rxtid = &an->an_aggr.rx.tid[tidno];
+				tidno < WME_NUM_TID;
+				tidno++, rxtid++) {
+			spin_lock_bh(&rxtid->tidlock);
+			rxtid->addba_exchangecomplete = 0;
+			ath_rx_reorder_sched(sc, rxtid);
+			spin_unlock_bh(&rxtid->tidlock);
+		}
+	}
+}
+
 void ath_rx_node_cleanup(struct ath_softc *sc, struct ath_node *an)
 {
 	if (sc->sc_rxaggr) {
@@ -1345,19 +1636,18 @@ void ath_rx_node_cleanup(struct ath_softc *sc, struct ath_node *an)
 				tidno < WME_NUM_TID;
 				tidno++, rxtid++) {
 
-			if (!rxtid->addba_exchangecomplete)
+			/* reordering may already be stopped, see detach */
+			if (rxtid->rxbuf == NULL)
 				continue;
 
-			/* must cancel timer first */
-			del_timer_sync(&rxtid->timer);
-
 			/* drop any pending sub-frames */
 			ath_rx_flush_tid(sc, rxtid, 1);
 
 			for (i = 0; i < ATH_TID_MAX_BUFS; i++)
 				ASSERT(rxtid->rxbuf[i].rx_wbuf == NULL);
 
-			rxtid->addba_exchangecomplete = 0;
+			kfree(rxtid->rxbuf);
+			rxtid->rxbuf = NULL;
 		}
 	}
 
@@ -0,0 +1,585 @@
+/*
+ * Copyright (c) 2008 Atheros Communications Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Baseband register shadow.
+ *
+ * Every REG_WRITE/REG_READ goes through here when the shadow is
+ * attached. Baseband registers that only software changes remember the
+ * last value written: reads of them are answered from memory and a
+ * write of the value already there is dropped. Registers the chip
+ * updates itself (calibration and noise floor control, status, the
+ * analog shift registers) are never cached. A chip reset puts every
+ * register back to its default, so the shadow is emptied then.
+ *
+ * While buffering, writes are appended to a log and issued in order on
+ * the next uncached read, when the log fills, or when buffering ends.
+ * ath9k_hw_reset() buffers the initvals tables this way. Only writes
+ * made on the cpu that started buffering, outside hard interrupt
+ * context, are held back; anything else flushes the log ahead of
+ * itself so the chip still sees every write in program order.
+ *
+ * REG_READ/REG_WRITE are used from the ISR, the tasklets and the
+ * calibration timer as well as from reset, so all of the state below
+ * is kept under rs_lock.
+ *
+ * Reset profiles build on the same hook. ath9k_hw_process_ini() runs
+ * right after a chip reset, so its output depends only on the channel
+ * and on a handful of settings (the profile key below); every register
+ * it reads back was written earlier in the same pass or holds its reset
+ * default. The writes of the first pass on a key are recorded and later
+ * passes on that key replay them instead of walking the tables again.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/hardirq.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "ath9k.h"
+#include "hw.h"
+#include "reg.h"
+#include "phy.h"
+
+static int shadow_enable;
+module_param_named(regshadow, shadow_enable, int, 0444);
+MODULE_PARM_DESC(regshadow, "Cache baseband registers and buffer reset "
+		 "register writes");
+
+static int profile_enable;
+module_param_named(resetprof, profile_enable, int, 0444);
+MODULE_PARM_DESC(resetprof, "Replay recorded per-channel reset register "
+		 "writes (needs regshadow)");
+
+#define SHADOW_BASE	AR_PHY_BASE
+#define SHADOW_END	0xc000		/* baseband chains 0-2 */
+#define SHADOW_NREGS	((SHADOW_END - SHADOW_BASE) >> 2)
+#define SHADOW_CHAIN	0x1000		/* offset between chain copies */
+#define SHADOW_LOGSZ	256		/* buffered writes */
+#define PROFILE_SLOTS	64		/* channel/setting combinations kept */
+#define PROFILE_MAXWRITES 2048		/* longest recording kept */
+
+/* written by the chip, or writes with side effects; chain 0 addresses */
+static const struct {
+	u_int32_t start;
+	u_int32_t end;
+} shadow_volatile[] = {
+	{ AR_PHY_AGC_CONTROL, AR_PHY_CCA + 4 },	/* cal/nf start, nf */
+	{ 0x9880, 0x9900 },			/* analog shift registers */
+	{ AR_PHY_TIMING_CTRL4(0), AR_PHY_TIMING_CTRL4(0) + 4 },
+	{ AR_PHY_RFBUS_REQ, AR_PHY_RFBUS_REQ + 4 },
+	{ AR_PHY_EXT_CCA, AR_PHY_EXT_CCA + 4 },
+	{ AR_PHY_CHAN_INFO_MEMORY, AR_PHY_CHAN_INFO_MEMORY + 4 },
+	{ 0x9c00, 0x9d00 },			/* status and cal results */
+};
+
+struct shadow_write {
+	u_int32_t reg;
+	u_int32_t val;
+};
+
+/* everything the output of ath9k_hw_process_ini() depends on */
+struct shadow_profile_key {
+	u_int32_t channelFlags;
+	u_int16_t channel;
+	int16_t powerLimit;
+	u_int tpScale;
+	u_int ctl;
+	u_int antennaAllowed;
+	int8_t maxRegTxPower;
+	u_int8_t txchainmask;
+	u_int8_t rxchainmask;
+	enum hal_ht_macmode macmode;
+	enum hal_ht_extprotspacing extprotspacing;
+};
+
+struct shadow_profile {
+	struct shadow_profile_key pr_key;
+	u_int16_t pr_maxPowerLevel;
+	int pr_nbank6;
+	u_int32_t *pr_bank6;		/* ah_analogBank6Data, pre-AR9280 */
+	int pr_nwrites;
+	struct shadow_write pr_writes[0];
+};
+
+struct ath9k_regshadow {
+	spinlock_t rs_lock;
+	u_int32_t rs_val[SHADOW_NREGS];
+	unsigned long rs_valid[BITS_TO_LONGS(SHADOW_NREGS)];
+	unsigned long rs_volatile[BITS_TO_LONGS(SHADOW_NREGS)];
+	struct shadow_write rs_log[SHADOW_LOGSZ];
+	int rs_nlog;
+	enum hal_bool rs_buffering;
+	int rs_owner;			/* cpu that started buffering */
+	struct hal_reg_stats rs_stats;	/* since attach */
+	struct hal_reg_stats rs_mark;	/* rs_stats when the reset began */
+	struct hal_reg_stats rs_reset;	/* cost of the last reset */
+
+	struct shadow_profile *rs_prof[PROFILE_SLOTS];
+	int rs_nprof;			/* slots in use */
+	int rs_profnext;		/* slot replaced next once full */
+	struct shadow_profile_key rs_profkey;	/* key of this reset */
+	struct shadow_write *rs_rec;	/* NULL unless profiles enabled */
+	int rs_nrec;
+	enum hal_bool rs_recording;
+	struct hal_prof_stats rs_profstats;
+};
+
+static inline int shadow_index(struct ath9k_regshadow *rs, u_int32_t reg)
+{
+	int idx;
+
+	if (reg < SHADOW_BASE || reg >= SHADOW_END)
+		return -1;
+	idx = (reg - SHADOW_BASE) >> 2;
+	if (test_bit(idx, rs->rs_volatile))
+		return -1;
+	return idx;
+}
+
+/*
+ * The context that started buffering or recording: reset runs with
+ * bottom halves off, so that is the owning cpu outside hardirq.
+ */
+static inline int shadow_owner(struct ath9k_regshadow *rs)
+{
+	return !in_irq() && rs->rs_owner == smp_processor_id();
+}
+
+static void shadow_flush_locked(struct ath_hal *ah,
+				struct ath9k_regshadow *rs)
+{
+	int i, regWrites = 0;
+
+	for (i = 0; i < rs->rs_nlog; i++) {
+		iowrite32(rs->rs_log[i].val, ah->ah_sh + rs->rs_log[i].reg);
+		DO_DELAY(regWrites);
+	}
+	rs->rs_stats.rs_writes += rs->rs_nlog;
+	rs->rs_nlog = 0;
+}
+
+void ath9k_hw_shadow_flush(struct ath_hal *ah)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	unsigned long flags;
+
+	if (rs == NULL)
+		return;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	shadow_flush_locked(ah, rs);
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+}
+
+u_int32_t ath9k_hw_shadow_read(struct ath_hal *ah, u_int32_t reg)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	int idx = shadow_index(rs, reg);
+	unsigned long flags;
+	u_int32_t val;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	if (idx >= 0 && test_bit(idx, rs->rs_valid)) {
+		rs->rs_stats.rs_reads_saved++;
+		val = rs->rs_val[idx];
+	} else {
+		if (rs->rs_nlog)
+			shadow_flush_locked(ah, rs);
+		rs->rs_stats.rs_reads++;
+		val = ioread32(ah->ah_sh + reg);
+	}
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+
+	return val;
+}
+
+/* recorded before the unchanged-value check: replay starts from reset */
+static inline void shadow_record(struct ath9k_regshadow *rs, u_int32_t reg,
+				 u_int32_t val)
+{
+	if (rs->rs_nrec < PROFILE_MAXWRITES) {
+		rs->rs_rec[rs->rs_nrec].reg = reg;
+		rs->rs_rec[rs->rs_nrec].val = val;
+	}
+	rs->rs_nrec++;
+}
+
+void ath9k_hw_shadow_write(struct ath_hal *ah, u_int32_t reg, u_int32_t val)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	int idx = shadow_index(rs, reg);
+	unsigned long flags;
+	int owner;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	owner = shadow_owner(rs);
+
+	if (rs->rs_recording && owner)
+		shadow_record(rs, reg, val);
+
+	if (idx >= 0) {
+		if (test_bit(idx, rs->rs_valid) && rs->rs_val[idx] == val) {
+			rs->rs_stats.rs_writes_saved++;
+			goto out;
+		}
+		rs->rs_val[idx] = val;
+		set_bit(idx, rs->rs_valid);
+	}
+
+	if (rs->rs_buffering && owner) {
+		if (rs->rs_nlog == SHADOW_LOGSZ)
+			shadow_flush_locked(ah, rs);
+		rs->rs_log[rs->rs_nlog].reg = reg;
+		rs->rs_log[rs->rs_nlog].val = val;
+		rs->rs_nlog++;
+		rs->rs_stats.rs_buffered++;
+		goto out;
+	}
+
+	if (rs->rs_nlog)
+		shadow_flush_locked(ah, rs);
+	iowrite32(val, ah->ah_sh + reg);
+	rs->rs_stats.rs_writes++;
+out:
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+}
+
+/* callers run with bottom halves disabled, see shadow_owner() */
+void ath9k_hw_shadow_buffer(struct ath_hal *ah, enum hal_bool enable)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	unsigned long flags;
+
+	if (rs == NULL)
+		return;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	if (enable)
+		rs->rs_owner = smp_processor_id();
+	else
+		shadow_flush_locked(ah, rs);
+	rs->rs_buffering = enable;
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+}
+
+void ath9k_hw_shadow_invalidate(struct ath_hal *ah)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	unsigned long flags;
+
+	if (rs == NULL)
+		return;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	bitmap_zero(rs->rs_valid, SHADOW_NREGS);
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+}
+
+#define SHADOW_DELTA(_f) \
+	(rs->rs_reset._f = rs->rs_stats._f - rs->rs_mark._f)
+
+void ath9k_hw_shadow_reset(struct ath_hal *ah, enum hal_bool done)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	unsigned long flags;
+
+	if (rs == NULL)
+		return;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	if (!done) {
+		rs->rs_mark = rs->rs_stats;
+	} else {
+		shadow_flush_locked(ah, rs);
+		rs->rs_stats.rs_resets++;
+		SHADOW_DELTA(rs_reads);
+		SHADOW_DELTA(rs_reads_saved);
+		SHADOW_DELTA(rs_writes);
+		SHADOW_DELTA(rs_writes_saved);
+		SHADOW_DELTA(rs_buffered);
+		rs->rs_reset.rs_resets = rs->rs_stats.rs_resets;
+	}
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+}
+
+#undef SHADOW_DELTA
+
+void ath9k_hw_shadow_getstats(struct ath_hal *ah,
+			      struct hal_reg_stats *total,
+			      struct hal_reg_stats *reset)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	unsigned long flags;
+
+	if (rs == NULL) {
+		memset(total, 0, sizeof(*total));
+		memset(reset, 0, sizeof(*reset));
+		return;
+	}
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	*total = rs->rs_stats;
+	*reset = rs->rs_reset;
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+}
+
+static void shadow_profile_key(struct ath_hal *ah, struct hal_channel *chan,
+			       struct hal_channel_internal *ichan,
+			       enum hal_ht_macmode macmode,
+			       struct shadow_profile_key *key)
+{
+	struct ath_hal_5416 *ahp = AH5416(ah);
+
+	memset(key, 0, sizeof(*key));
+	key->channelFlags = chan->channelFlags & CHANNEL_ALL;
+	key->channel = chan->channel;
+	key->powerLimit = ah->ah_powerLimit;
+	key->tpScale = ah->ah_tpScale;
+	key->ctl = ath9k_regd_get_ctl(ah, chan);
+	key->antennaAllowed = ath9k_regd_get_antenna_allowed(ah, chan);
+	key->maxRegTxPower = ichan->maxRegTxPower;
+	key->txchainmask = ahp->ah_txchainmask;
+	key->rxchainmask = ahp->ah_rxchainmask;
+	key->macmode = macmode;
+	key->extprotspacing = ahp->ah_extprotspacing;
+}
+
+static struct shadow_profile *
+shadow_profile_find(struct ath9k_regshadow *rs,
+		    struct shadow_profile_key *key)
+{
+	int i;
+
+	for (i = 0; i < rs->rs_nprof; i++) {
+		if (memcmp(&rs->rs_prof[i]->pr_key, key, sizeof(*key)) == 0)
+			return rs->rs_prof[i];
+	}
+	return NULL;
+}
+
+/*
+ * Issue the recorded writes for this channel, if there are any. On a
+ * miss the key is kept for ath9k_hw_profile_record().
+ */
+enum hal_bool ath9k_hw_profile_replay(struct ath_hal *ah,
+				      struct hal_channel *chan,
+				      struct hal_channel_internal *ichan,
+				      enum hal_ht_macmode macmode)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	struct shadow_profile *pr;
+	u_int32_t reg;
+	int i;
+
+	if (rs == NULL || rs->rs_rec == NULL)
+		return AH_FALSE;
+
+	shadow_profile_key(ah, chan, ichan, macmode, &rs->rs_profkey);
+	pr = shadow_profile_find(rs, &rs->rs_profkey);
+	if (pr == NULL || pr->pr_nwrites == 0) {
+		/* an empty profile would leave the chip at its defaults */
+		rs->rs_profstats.ps_misses++;
+		return AH_FALSE;
+	}
+
+	ath9k_hw_shadow_buffer(ah, AH_TRUE);
+	for (i = 0; i < pr->pr_nwrites; i++) {
+		reg = pr->pr_writes[i].reg;
+		ath9k_hw_shadow_write(ah, reg, pr->pr_writes[i].val);
+
+		if (reg >= 0x7800 && reg < 0x78a0
+		    && ah->ah_config.ath_hal_analogShiftReg) {
+			ath9k_hw_shadow_flush(ah);
+			udelay(100);
+		}
+	}
+	ath9k_hw_shadow_buffer(ah, AH_FALSE);
+
+	/* software state the recorded pass left behind */
+	ah->ah_maxPowerLevel = pr->pr_maxPowerLevel;
+	if (pr->pr_nbank6)
+		memcpy(ahp->ah_analogBank6Data, pr->pr_bank6,
+		       pr->pr_nbank6 * sizeof(u_int32_t));
+
+	rs->rs_profstats.ps_hits++;
+	return AH_TRUE;
+}
+
+/* start recording under the key the preceding replay attempt missed */
+void ath9k_hw_profile_record(struct ath_hal *ah)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	unsigned long flags;
+
+	if (rs == NULL || rs->rs_rec == NULL)
+		return;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	rs->rs_owner = smp_processor_id();
+	rs->rs_nrec = 0;
+	rs->rs_recording = AH_TRUE;
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+}
+
+void ath9k_hw_profile_save(struct ath_hal *ah, enum hal_bool ok)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	struct ath_hal_5416 *ahp = AH5416(ah);
+	struct shadow_profile *pr;
+	unsigned long flags;
+	int nbank6 = 0, slot;
+
+	if (rs == NULL || !rs->rs_recording)
+		return;
+
+	spin_lock_irqsave(&rs->rs_lock, flags);
+	rs->rs_recording = AH_FALSE;
+	spin_unlock_irqrestore(&rs->rs_lock, flags);
+	if (!ok)
+		return;
+
+	if (rs->rs_nrec == 0 || rs->rs_nrec > PROFILE_MAXWRITES) {
+		rs->rs_profstats.ps_dropped++;
+		return;
+	}
+
+	if (!AR_SREV_9280_10_OR_LATER(ah) && ahp->ah_analogBank6Data != NULL)
+		nbank6 = ahp->ah_iniBank6TPC.ia_rows;
+
+	/* ath9k_hw_reset() runs under the reset spinlock */
+	pr = kmalloc(sizeof(*pr) +
+		     rs->rs_nrec * sizeof(struct shadow_write) +
+		     nbank6 * sizeof(u_int32_t), GFP_ATOMIC);
+	if (pr == NULL) {
+		rs->rs_profstats.ps_dropped++;
+		return;
+	}
+
+	pr->pr_key = rs->rs_profkey;
+	pr->pr_maxPowerLevel = ah->ah_maxPowerLevel;
+	pr->pr_nwrites = rs->rs_nrec;
+	memcpy(pr->pr_writes, rs->rs_rec,
+	       rs->rs_nrec * sizeof(struct shadow_write));
+	pr->pr_nbank6 = nbank6;
+	pr->pr_bank6 = (u_int32_t *) &pr->pr_writes[rs->rs_nrec];
+	if (nbank6)
+		memcpy(pr->pr_bank6, ahp->ah_analogBank6Data,
+		       nbank6 * sizeof(u_int32_t));
+
+	if (rs->rs_nprof < PROFILE_SLOTS) {
+		slot = rs->rs_nprof++;
+	} else {
+		slot = rs->rs_profnext;
+		rs->rs_profnext = (slot + 1) % PROFILE_SLOTS;
+		rs->rs_profstats.ps_writes -= rs->rs_prof[slot]->pr_nwrites;
+		rs->rs_profstats.ps_evicted++;
+		kfree(rs->rs_prof[slot]);
+	}
+	rs->rs_prof[slot] = pr;
+	rs->rs_profstats.ps_writes += pr->pr_nwrites;
+	rs->rs_profstats.ps_profiles = rs->rs_nprof;
+}
+
+void ath9k_hw_profile_flush(struct ath_hal *ah)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+	int i;
+
+	if (rs == NULL)
+		return;
+
+	for (i = 0; i < rs->rs_nprof; i++) {
+		kfree(rs->rs_prof[i]);
+		rs->rs_prof[i] = NULL;
+	}
+	rs->rs_nprof = 0;
+	rs->rs_profnext = 0;
+	rs->rs_profstats.ps_profiles = 0;
+	rs->rs_profstats.ps_writes = 0;
+}
+
+void ath9k_hw_profile_getstats(struct ath_hal *ah,
+			       struct hal_prof_stats *stats)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+
+	if (rs == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	*stats = rs->rs_profstats;
+}
+
+void ath9k_hw_shadow_attach(struct ath_hal *ah)
+{
+	struct ath9k_regshadow *rs;
+	u_int32_t reg;
+	int i, chain;
+
+	ah->ah_shadow = NULL;
+	if (!shadow_enable)
+		return;
+
+	rs = kzalloc(sizeof(*rs), GFP_KERNEL);
+	if (rs == NULL) {
+		HDPRINTF(ah, HAL_DBG_UNMASKABLE,
+			 "%s: no memory for register shadow\n", __func__);
+		return;
+	}
+	spin_lock_init(&rs->rs_lock);
+
+	for (i = 0; i < ARRAY_SIZE(shadow_volatile); i++) {
+		for (chain = 0; chain < 3; chain++) {
+			for (reg = shadow_volatile[i].start;
+			     reg < shadow_volatile[i].end; reg += 4)
+				__set_bit(((reg + chain * SHADOW_CHAIN) -
+					   SHADOW_BASE) >> 2,
+					  rs->rs_volatile);
+		}
+	}
+
+	if (profile_enable) {
+		rs->rs_rec = kmalloc(PROFILE_MAXWRITES *
+				     sizeof(struct shadow_write), GFP_KERNEL);
+		if (rs->rs_rec == NULL)
+			HDPRINTF(ah, HAL_DBG_UNMASKABLE,
+				 "%s: no memory for reset profiles\n",
+				 __func__);
+	}
+
+	ah->ah_shadow = rs;
+
+	printk(KERN_INFO "ath9k: baseband register shadow enabled%s\n",
+	       rs->rs_rec ? ", reset profiles" : "");
+}
+
+void ath9k_hw_shadow_detach(struct ath_hal *ah)
+{
+	struct ath9k_regshadow *rs = ah->ah_shadow;
+
+	if (rs == NULL)
+		return;
+
+	ath9k_hw_shadow_flush(ah);
+	ath9k_hw_profile_flush(ah);
+	ah->ah_shadow = NULL;
+	kfree(rs->rs_rec);
+	kfree(rs);
+}
@@ -0,0 +1,657 @@
+/*
+ * Copyright (c) 2008 Atheros Communications Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Software model of the AR5416 DMA engine.
+ *
+ * The model replaces the queue and interrupt status registers used by
+ * the data path: TXDP/TxE, RXDP/RxE and the ISR. Descriptors are
+ * walked exactly like the hardware does (following ds_link, keeping
+ * the last fetched descriptor so a later link can be picked up) and
+ * completed by writing the hardware status words, so the regular
+ * ath9k_hw_txprocdesc/ath9k_hw_rxprocdesc decoders are used unchanged.
+ *
+ * Air time is taken from the packet durations the driver programs into
+ * the rate series, plus a fixed per-attempt overhead. Loss is applied
+ * per MPDU and the block-ack bitmap may additionally be masked with a
+ * fixed pattern, which makes BA handling repeatable.
+ *
+ * Once attached, chip reset, calibration and tx/rx DMA stop are served
+ * by the model too and do not touch the card, so channel changes, scans
+ * and resets cost what the driver spends, not what the chip does. The
+ * model is still attached to a probed device: chip identity, EEPROM
+ * and capabilities come from the card at ath9k_hw_attach time, and
+ * configuration writes outside the data path (key cache, filters,
+ * beacon timers) still go to it.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/ieee80211.h>
+
+#include "ath9k.h"
+#include "hw.h"
+#include "reg.h"
+
+static int sim_enable;
+module_param_named(sim, sim_enable, int, 0444);
+MODULE_PARM_DESC(sim, "Complete tx/rx DMA in the software chip model");
+
+static int sim_overhead = 100;
+module_param(sim_overhead, int, 0444);
+MODULE_PARM_DESC(sim_overhead, "Per-attempt channel access overhead, usec");
+
+static int sim_loss;
+module_param(sim_loss, int, 0444);
+MODULE_PARM_DESC(sim_loss, "MPDU loss rate, per 1000");
+
+static uint sim_ba_low = 0xffffffff;
+module_param(sim_ba_low, uint, 0444);
+MODULE_PARM_DESC(sim_ba_low, "Block-ack mask for subframes 0-31");
+
+static uint sim_ba_high = 0xffffffff;
+module_param(sim_ba_high, uint, 0444);
+MODULE_PARM_DESC(sim_ba_high, "Block-ack mask for subframes 32-63");
+
+#define SIM_MAX_REGIONS		4	/* rx, tx, beacon and one spare */
+#define SIM_MAX_SUBFRAMES	64	/* block-ack window */
+#define SIM_MAX_DESC		256	/* descriptors walked per unit */
+#define SIM_NUM_SERIES		4
+#define SIM_SEQ_MAX		4096
+
+struct sim_region {
+	void *sr_va;
+	u_int32_t sr_pa;
+	u_int32_t sr_len;
+};
+
+struct sim_txq {
+	u_int32_t sq_txdp;	/* next descriptor to fetch */
+	u_int32_t sq_last;	/* last fetched, its link is re-read */
+};
+
+struct ath9k_sim {
+	struct ath_hal *sim_ah;
+	spinlock_t sim_lock;
+	struct hal_sim_config sim_config;
+	struct hal_sim_stats sim_stats;
+	struct sim_region sim_region[SIM_MAX_REGIONS];
+	struct sim_txq sim_txq[HAL_NUM_TX_QUEUES];
+	u_int32_t sim_rxdp;
+	u_int32_t sim_rxlast;
+	enum hal_bool sim_rxena;
+	u_int64_t sim_tsf;		/* virtual time, usec */
+	u_int32_t sim_isr;		/* pending HAL_INT_* */
+	u_int32_t sim_txqs;		/* queues with pending tx interrupts */
+	enum hal_int sim_imask;
+	struct tasklet_struct sim_intr_tq;
+	irq_handler_t sim_handler;
+	void *sim_handler_arg;
+};
+
+static struct ath_desc *sim_pa2desc(struct ath9k_sim *sim, u_int32_t pa)
+{
+	struct sim_region *sr;
+	int i;
+
+	if (pa == 0)
+		return NULL;
+
+	for (i = 0; i < SIM_MAX_REGIONS; i++) {
+		sr = &sim->sim_region[i];
+		if (sr->sr_va != NULL && pa >= sr->sr_pa &&
+		    pa - sr->sr_pa < sr->sr_len)
+			return (struct ath_desc *)
+				((u_int8_t *)sr->sr_va + (pa - sr->sr_pa));
+	}
+	return NULL;
+}
+
+static inline int sim_lost(struct ath9k_sim *sim)
+{
+	if (sim->sim_config.sim_loss == 0)
+		return 0;
+	return (random32() % 1000) < sim->sim_config.sim_loss;
+}
+
+static u_int16_t sim_seqno(const struct ath_desc *ds)
+{
+	const struct ieee80211_hdr *hdr = ds->ds_vdata;
+
+	if (hdr == NULL)
+		return 0;
+	return (le16_to_cpu(hdr->seq_ctrl) & IEEE80211_SCTL_SEQ) >> 4;
+}
+
+static u_int sim_series_tries(const struct ar5416_desc *ads, int series)
+{
+	switch (series) {
+	case 0:
+		return MS(ads->ds_ctl2, AR_XmitDataTries0);
+	case 1:
+		return MS(ads->ds_ctl2, AR_XmitDataTries1);
+	case 2:
+		return MS(ads->ds_ctl2, AR_XmitDataTries2);
+	default:
+		return MS(ads->ds_ctl2, AR_XmitDataTries3);
+	}
+}
+
+static u_int sim_series_duration(const struct ar5416_desc *ads, int series)
+{
+	switch (series) {
+	case 0:
+		return MS(ads->ds_ctl4, AR_PacketDur0);
+	case 1:
+		return MS(ads->ds_ctl4, AR_PacketDur1);
+	case 2:
+		return MS(ads->ds_ctl5, AR_PacketDur2);
+	default:
+		return MS(ads->ds_ctl5, AR_PacketDur3);
+	}
+}
+
+static void sim_schedule(struct ath9k_sim *sim)
+{
+	if ((sim->sim_imask & HAL_INT_GLOBAL) &&
+	    (sim->sim_isr & sim->sim_imask) &&
+	    sim->sim_handler != NULL)
+		tasklet_schedule(&sim->sim_intr_tq);
+}
+
+static void sim_intr_tasklet(unsigned long data)
+{
+	struct ath9k_sim *sim = (struct ath9k_sim *)data;
+
+	sim->sim_handler(0, sim->sim_handler_arg);
+}
+
+/*
+ * Transmit one unit (a single frame or a whole aggregate) starting at
+ * descriptor ds and write the completion status to its last descriptor.
+ * Returns the physical address of the last descriptor, or 0 if the
+ * unit is not completely linked yet.
+ */
+static u_int32_t sim_tx_unit(struct ath9k_sim *sim, u_int q,
+			     struct ath_desc *ds, u_int32_t pa)
+{
+	struct ath_hal_5416 *ahp = AH5416(sim->sim_ah);
+	struct ar5416_desc *first = AR5416DESC(ds);
+	struct ar5416_desc *last;
+	u_int16_t seqno[SIM_MAX_SUBFRAMES];
+	u_int32_t ba_mask[2], ba[2];
+	u_int32_t airtime = 0;
+	u_int nsub = 0, ndesc = 0, failcnt = 0, tries, dur;
+	int series, i, done = 0, isaggr, intreq;
+	u_int16_t seq_st;
+
+	isaggr = (first->ds_ctl1 & AR_IsAggr) != 0;
+	intreq = (first->ds_ctl0 & AR_TxIntrReq) != 0;
+
+	/*
+	 * Walk the unit: a frame ends with a descriptor without TxMore,
+	 * an aggregate ends with the frame that has IsAggr but no
+	 * MoreAggr.
+	 */
+	last = first;
+	seqno[nsub++] = sim_seqno(ds);
+	while (ndesc++ < SIM_MAX_DESC) {
+		last = AR5416DESC(ds);
+		if (!(last->ds_ctl1 & AR_TxMore) &&
+		    (!isaggr || !(last->ds_ctl1 & AR_MoreAggr)))
+			break;
+
+		if (last->ds_link == 0)
+			return 0;	/* wait for the rest to be linked */
+		pa = last->ds_link;
+		ds = sim_pa2desc(sim, pa);
+		if (ds == NULL)
+			return 0;
+
+		/* a new subframe starts after a descriptor without TxMore */
+		if (!(last->ds_ctl1 & AR_TxMore) && nsub < SIM_MAX_SUBFRAMES)
+			seqno[nsub++] = sim_seqno(ds);
+	}
+
+	ba_mask[0] = sim->sim_config.sim_ba_low;
+	ba_mask[1] = sim->sim_config.sim_ba_high;
+	ba[0] = ba[1] = 0;
+
+	for (series = 0; series < SIM_NUM_SERIES && !done; series++) {
+		tries = sim_series_tries(first, series);
+		dur = sim_series_duration(first, series);
+
+		while (tries-- > 0) {
+			airtime += sim->sim_config.sim_overhead + dur;
+
+			if (isaggr) {
+				for (i = 0; i < nsub; i++) {
+					if (sim_lost(sim)) {
+						sim->sim_stats.ss_txlost++;
+						continue;
+					}
+					ba[i >> 5] |= 1U << (i & 31);
+				}
+				ba[0] &= ba_mask[0];
+				ba[1] &= ba_mask[1];
+				done = ba[0] || ba[1];
+			} else {
+				done = !sim_lost(sim);
+				if (!done)
+					sim->sim_stats.ss_txlost++;
+			}
+			if (done)
+				break;
+			failcnt++;
+		}
+	}
+	if (done)
+		series--;
+	else
+		series = SIM_NUM_SERIES - 1;
+
+	sim->sim_tsf += airtime;
+	sim->sim_stats.ss_airtime += airtime;
+	sim->sim_stats.ss_txppdu++;
+	sim->sim_stats.ss_txmpdu += nsub;
+
+	/*
+	 * Hardware reports the block-ack bitmap relative to the sequence
+	 * number of the first subframe; translate subframe positions.
+	 */
+	seq_st = seqno[0];
+	if (isaggr && done) {
+		u_int32_t bitmap[2] = { 0, 0 };
+		u_int idx;
+
+		for (i = 0; i < nsub; i++) {
+			if (!(ba[i >> 5] & (1U << (i & 31))))
+				continue;
+			idx = (seqno[i] - seq_st) & (SIM_SEQ_MAX - 1);
+			if (idx < SIM_MAX_SUBFRAMES)
+				bitmap[idx >> 5] |= 1U << (idx & 31);
+		}
+		ba[0] = bitmap[0];
+		ba[1] = bitmap[1];
+	}
+
+	last->ds_txstatus0 = (isaggr && done) ? AR_TxBaStatus : 0;
+	last->ds_txstatus1 = (done ? AR_FrmXmitOK : AR_ExcessiveRetries) |
+		SM(min(failcnt, 15U), AR_DataFailCnt);
+	last->AR_SendTimestamp = (u_int32_t)sim->sim_tsf;
+	last->AR_BaBitmapLow = ba[0];
+	last->AR_BaBitmapHigh = ba[1];
+	last->ds_txstatus5 = SM((u_int8_t)sim->sim_config.sim_rssi,
+				AR_TxRSSICombined);
+	last->ds_txstatus6 = last->ds_txstatus7 = last->ds_txstatus8 = 0;
+	last->ds_txstatus9 = AR_TxDone | SM(seq_st, AR_SeqNum) |
+		SM(series, AR_FinalTxIdx);
+
+	if (!done)
+		sim->sim_stats.ss_txxretry++;
+
+	if ((ahp->ah_txOkInterruptMask & (1 << q)) ||
+	    (!done && (ahp->ah_txErrInterruptMask & (1 << q))) ||
+	    (intreq && (ahp->ah_txDescInterruptMask & (1 << q))) ||
+	    (last->ds_link == 0 && (ahp->ah_txEolInterruptMask & (1 << q)))) {
+		sim->sim_isr |= HAL_INT_TX;
+		sim->sim_txqs |= 1 << q;
+	}
+
+	return pa;
+}
+
+enum hal_bool ath9k_hw_sim_puttxbuf(struct ath_hal *ah, u_int q,
+				    u_int32_t txdp)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	sim->sim_txq[q].sq_txdp = txdp;
+	sim->sim_txq[q].sq_last = 0;
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+
+	return AH_TRUE;
+}
+
+u_int32_t ath9k_hw_sim_gettxbuf(struct ath_hal *ah, u_int q)
+{
+	return ah->ah_sim->sim_txq[q].sq_txdp;
+}
+
+enum hal_bool ath9k_hw_sim_txstart(struct ath_hal *ah, u_int q)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	struct sim_txq *sq = &sim->sim_txq[q];
+	struct ath_desc *ds;
+	unsigned long flags;
+	u_int32_t lastpa;
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+
+	/* pick up a link written into the last fetched descriptor */
+	if (sq->sq_txdp == 0 && sq->sq_last != 0) {
+		ds = sim_pa2desc(sim, sq->sq_last);
+		if (ds != NULL && ds->ds_link != 0)
+			sq->sq_txdp = ds->ds_link;
+	}
+
+	while (sq->sq_txdp != 0) {
+		ds = sim_pa2desc(sim, sq->sq_txdp);
+		if (ds == NULL) {
+			HDPRINTF(ah, HAL_DBG_TX,
+				 "%s: q %u txdp 0x%x outside known regions\n",
+				 __func__, q, sq->sq_txdp);
+			sq->sq_txdp = 0;
+			break;
+		}
+
+		lastpa = sim_tx_unit(sim, q, ds, sq->sq_txdp);
+		if (lastpa == 0)
+			break;
+
+		sq->sq_last = lastpa;
+		sq->sq_txdp = sim_pa2desc(sim, lastpa)->ds_link;
+	}
+
+	sim_schedule(sim);
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+
+	return AH_TRUE;
+}
+
+void ath9k_hw_sim_putrxbuf(struct ath_hal *ah, u_int32_t rxdp)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	sim->sim_rxdp = rxdp;
+	sim->sim_rxlast = 0;
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+}
+
+void ath9k_hw_sim_rxena(struct ath_hal *ah, enum hal_bool enable)
+{
+	ah->ah_sim->sim_rxena = enable;
+}
+
+/*
+ * Receive a frame: the next free rx descriptor is filled in and the
+ * frame body is copied to the buffer the driver attached to it.
+ */
+enum hal_bool ath9k_hw_sim_rxinject(struct ath_hal *ah, const void *frame,
+				    u_int len, u_int8_t rate, u_int flags)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	struct ath_desc *ds = NULL;
+	struct ar5416_desc *ads;
+	unsigned long irqflags;
+	u_int buflen;
+
+	spin_lock_irqsave(&sim->sim_lock, irqflags);
+
+	if (!sim->sim_rxena) {
+		spin_unlock_irqrestore(&sim->sim_lock, irqflags);
+		return AH_FALSE;
+	}
+
+	if (sim->sim_rxdp == 0 && sim->sim_rxlast != 0) {
+		ds = sim_pa2desc(sim, sim->sim_rxlast);
+		if (ds != NULL && ds->ds_link != 0)
+			sim->sim_rxdp = ds->ds_link;
+	}
+	ds = sim_pa2desc(sim, sim->sim_rxdp);
+	if (ds == NULL || (AR5416DESC(ds)->ds_rxstatus8 & AR_RxDone)) {
+		sim->sim_stats.ss_rxdrop++;
+		sim->sim_isr |= HAL_INT_RXEOL;
+		sim_schedule(sim);
+		spin_unlock_irqrestore(&sim->sim_lock, irqflags);
+		return AH_FALSE;
+	}
+
+	ads = AR5416DESC(ds);
+	buflen = ads->ds_ctl1 & AR_BufLen;
+	if (len > buflen)
+		len = buflen;
+	if (frame != NULL && ds->ds_vdata != NULL)
+		memcpy(ds->ds_vdata, frame, len);
+
+	sim->sim_tsf += sim->sim_config.sim_overhead;
+
+	ads->ds_rxstatus0 = SM(rate, AR_RxRate);
+	ads->ds_rxstatus1 = len & AR_DataLen;
+	ads->AR_RcvTimestamp = (u_int32_t)sim->sim_tsf;
+	ads->ds_rxstatus3 = 0;
+	ads->ds_rxstatus4 = SM((u_int8_t)sim->sim_config.sim_rssi,
+			       AR_RxRSSICombined);
+	ads->ds_rxstatus8 = AR_RxDone;
+	if (flags & HAL_SIM_RX_AGGR)
+		ads->ds_rxstatus8 |= AR_RxAggr;
+	if (flags & HAL_SIM_RX_MOREAGGR)
+		ads->ds_rxstatus8 |= AR_RxMoreAggr;
+	if (sim_lost(sim))
+		ads->ds_rxstatus8 |= AR_CRCErr;
+	else
+		ads->ds_rxstatus8 |= AR_RxFrameOK;
+
+	sim->sim_stats.ss_rxframes++;
+
+	sim->sim_rxlast = sim->sim_rxdp;
+	sim->sim_rxdp = ds->ds_link;
+
+	sim->sim_isr |= HAL_INT_RX;
+	sim_schedule(sim);
+	spin_unlock_irqrestore(&sim->sim_lock, irqflags);
+
+	return AH_TRUE;
+}
+
+enum hal_bool ath9k_hw_sim_intrpend(struct ath_hal *ah)
+{
+	return ah->ah_sim->sim_isr != 0 ? AH_TRUE : AH_FALSE;
+}
+
+enum hal_bool ath9k_hw_sim_getisr(struct ath_hal *ah, enum hal_int *masked)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	*masked = sim->sim_isr;
+	AH5416(ah)->ah_intrTxqs |= sim->sim_txqs;
+	sim->sim_isr = 0;
+	sim->sim_txqs = 0;
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+
+	return *masked != 0 ? AH_TRUE : AH_FALSE;
+}
+
+enum hal_int ath9k_hw_sim_set_interrupts(struct ath_hal *ah,
+					 enum hal_int ints)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	enum hal_int omask;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	omask = sim->sim_imask;
+	sim->sim_imask = ints;
+	AH5416(ah)->ah_maskReg = ints;
+	sim_schedule(sim);
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+
+	return omask;
+}
+
+void ath9k_hw_sim_setisr(struct ath_hal *ah, irq_handler_t handler,
+			 void *arg)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+
+	if (sim == NULL)
+		return;
+
+	tasklet_kill(&sim->sim_intr_tq);
+	sim->sim_handler = handler;
+	sim->sim_handler_arg = arg;
+}
+
+void ath9k_hw_sim_addregion(struct ath_hal *ah, void *va,
+			    u_int32_t pa, u_int32_t len)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	int i;
+
+	if (sim == NULL)
+		return;
+
+	for (i = 0; i < SIM_MAX_REGIONS; i++) {
+		if (sim->sim_region[i].sr_va == NULL) {
+			sim->sim_region[i].sr_va = va;
+			sim->sim_region[i].sr_pa = pa;
+			sim->sim_region[i].sr_len = len;
+			return;
+		}
+	}
+	HDPRINTF(ah, HAL_DBG_UNMASKABLE,
+		 "%s: no free region for %p\n", __func__, va);
+}
+
+void ath9k_hw_sim_delregion(struct ath_hal *ah, void *va)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	int i;
+
+	if (sim == NULL)
+		return;
+
+	for (i = 0; i < SIM_MAX_REGIONS; i++) {
+		if (sim->sim_region[i].sr_va == va)
+			memset(&sim->sim_region[i], 0,
+			       sizeof(sim->sim_region[i]));
+	}
+}
+
+/*
+ * Stands in for a chip reset: every queue and the rx engine stop and
+ * forget their descriptor pointers, pending interrupts are dropped.
+ */
+void ath9k_hw_sim_reset(struct ath_hal *ah)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	memset(sim->sim_txq, 0, sizeof(sim->sim_txq));
+	sim->sim_rxdp = 0;
+	sim->sim_rxlast = 0;
+	sim->sim_rxena = AH_FALSE;
+	sim->sim_isr = 0;
+	sim->sim_txqs = 0;
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+}
+
+void ath9k_hw_sim_setconfig(struct ath_hal *ah,
+			    const struct hal_sim_config *config)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	unsigned long flags;
+
+	if (sim == NULL)
+		return;
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	sim->sim_config = *config;
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+}
+
+void ath9k_hw_sim_getconfig(struct ath_hal *ah, struct hal_sim_config *config)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	unsigned long flags;
+
+	if (sim == NULL) {
+		memset(config, 0, sizeof(*config));
+		return;
+	}
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	*config = sim->sim_config;
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+}
+
+void ath9k_hw_sim_getstats(struct ath_hal *ah, struct hal_sim_stats *stats)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+	unsigned long flags;
+
+	if (sim == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	spin_lock_irqsave(&sim->sim_lock, flags);
+	*stats = sim->sim_stats;
+	spin_unlock_irqrestore(&sim->sim_lock, flags);
+}
+
+void ath9k_hw_sim_attach(struct ath_hal *ah)
+{
+	struct ath9k_sim *sim;
+
+	ah->ah_sim = NULL;
+	if (!sim_enable)
+		return;
+
+	sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+	if (sim == NULL) {
+		HDPRINTF(ah, HAL_DBG_UNMASKABLE,
+			 "%s: no memory for chip model\n", __func__);
+		return;
+	}
+
+	sim->sim_ah = ah;
+	spin_lock_init(&sim->sim_lock);
+	tasklet_init(&sim->sim_intr_tq, sim_intr_tasklet,
+		     (unsigned long)sim);
+
+	sim->sim_config.sim_overhead = sim_overhead;
+	sim->sim_config.sim_loss = sim_loss;
+	sim->sim_config.sim_ba_low = sim_ba_low;
+	sim->sim_config.sim_ba_high = sim_ba_high;
+	sim->sim_config.sim_rssi = 40;
+
+	ah->ah_sim = sim;
+
+	printk(KERN_INFO "ath9k: tx/rx DMA completed by the software "
+	       "chip model\n");
+}
+
+void ath9k_hw_sim_detach(struct ath_hal *ah)
+{
+	struct ath9k_sim *sim = ah->ah_sim;
+
+	if (sim == NULL)
+		return;
+
+	tasklet_kill(&sim->sim_intr_tq);
+	ah->ah_sim = NULL;
+	kfree(sim);
+}
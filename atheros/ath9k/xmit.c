@@ -80,6 +80,7 @@ static void ath_tx_mcastqaddbuf(struct ath_softc *sc,
 	 * pass it on to the hardware.
 	 */
 	bf = list_first_entry(head, struct ath_buf, list);
+	ath_txlat_stamp_list(head, ATH_TXLAT_HWQ);
 
 	/*
 	 * The CAB queue is started from the SWBA handler since
@@ -132,6 +133,32 @@ static void ath_tx_mcastqaddbuf(struct ath_softc *sc,
 	ath9k_hw_set_interrupts(ah, sc->sc_imask);
 }
 
+/*
+ * Ring the doorbell for everything linked since the last one: load
+ * TXDP if the queue was empty, then a single TxE write.
+ * NB: must be called with txq lock held
+ */
+
+static void ath_tx_txqkick(struct ath_softc *sc, struct ath_txq *txq)
+{
+	struct ath_hal *ah = sc->sc_ah;
+	int nwrites = 1;
+
+	if (!txq->axq_kickframes)
+		return;
+
+	if (txq->axq_txdpbuf) {
+		ath9k_hw_puttxbuf(ah, txq->axq_qnum,
+				  txq->axq_txdpbuf->bf_daddr);
+		txq->axq_txdpbuf = NULL;
+		nwrites++;
+	}
+	ath9k_hw_txstart(ah, txq->axq_qnum);
+
+	ath9k_debug_txkick(sc, txq->axq_kickframes, nwrites);
+	txq->axq_kickframes = 0;
+}
+
 /*
  * Insert a chain of ath_buf (descriptors) on a txq and
  * assume the descriptors are already chained together by caller.
@@ -141,7 +168,6 @@ static void ath_tx_mcastqaddbuf(struct ath_softc *sc,
 static void ath_tx_txqaddbuf(struct ath_softc *sc,
 		struct ath_txq *txq, struct list_head *head)
 {
-	struct ath_hal *ah = sc->sc_ah;
 	struct ath_buf *bf;
 	/*
 	 * Insert the frame on the outbound list and
@@ -152,6 +178,7 @@ static void ath_tx_txqaddbuf(struct ath_softc *sc,
 		return;
 
 	bf = list_first_entry(head, struct ath_buf, list);
+	ath_txlat_stamp_list(head, ATH_TXLAT_HWQ);
 
 	list_splice_tail_init(head, &txq->axq_q);
 	txq->axq_depth++;
@@ -162,7 +189,8 @@ static void ath_tx_txqaddbuf(struct ath_softc *sc,
 		"%s: txq depth = %d\n", __func__, txq->axq_depth);
 
 	if (txq->axq_link == NULL) {
-		ath9k_hw_puttxbuf(ah, txq->axq_qnum, bf->bf_daddr);
+		/* loaded into TXDP by the doorbell */
+		txq->axq_txdpbuf = bf;
 		DPRINTF(sc, ATH_DEBUG_XMIT,
 			"%s: TXDP[%u] = %llx (%p)\n",
 			__func__, txq->axq_qnum,
@@ -175,7 +203,28 @@ static void ath_tx_txqaddbuf(struct ath_softc *sc,
 			ito64(bf->bf_daddr), bf->bf_desc);
 	}
 	txq->axq_link = &(bf->bf_lastbf->bf_desc->ds_link);
-	ath9k_hw_txstart(ah, txq->axq_qnum);
+	txq->axq_kickframes += bf->bf_nframes ? bf->bf_nframes : 1;
+
+	if (!txq->axq_batch)
+		ath_tx_txqkick(sc, txq);
+}
+
+/*
+ * Batched enqueue: between begin and end, ath_tx_txqaddbuf() only links
+ * the chains in memory and the doorbell is rung once at the end.
+ * NB: must be called with txq lock held, and the lock must not be
+ * dropped inside the batch.
+ */
+
+static void ath_txq_batch_begin(struct ath_txq *txq)
+{
+	txq->axq_batch++;
+}
+
+static void ath_txq_batch_end(struct ath_softc *sc, struct ath_txq *txq)
+{
+	if (--txq->axq_batch == 0)
+		ath_tx_txqkick(sc, txq);
 }
 
 /* Get transmit rate index using rate in Kbps */
@@ -258,6 +307,18 @@ static void fill_min_rates(struct sk_buff *skb, struct ath_tx_control *txctl)
 
 }
 
+/* Index of the vap a frame is sent on, the first one if unknown */
+static int ath_tx_vap_id(struct ath_softc *sc, struct ieee80211_vif *vif)
+{
+	int i;
+
+	for (i = 0; i < ATH_BCBUF; i++) {
+		if (sc->sc_vaps[i] != NULL && sc->sc_vaps[i]->av_if_data == vif)
+			return i;
+	}
+	return 0;
+}
+
 /* This function will setup additional txctl information, mostly rate stuff */
 /* FIXME: seqno, ps */
 static int ath_tx_prepare(struct ath_softc *sc,
@@ -288,19 +349,14 @@ static int ath_tx_prepare(struct ath_softc *sc,
 
 	/* Fill misc fields */
 
-	spin_lock_bh(&sc->node_lock);
-	txctl->an = ath_node_get(sc, hdr->addr1);
-	/* create a temp node, if the node is not there already */
-	if (!txctl->an)
-		txctl->an = ath_node_attach(sc, hdr->addr1, 0);
-	spin_unlock_bh(&sc->node_lock);
+	txctl->if_id = ath_tx_vap_id(sc, tx_info->control.vif);
+	txctl->an = ath_node_tx_get(sc, txctl->if_id, hdr->addr1);
 
 	if (ieee80211_is_data_qos(fc)) {
 		qc = ieee80211_get_qos_ctl(hdr);
 		txctl->tidno = qc[0] & 0xf;
 	}
 
-	txctl->if_id = 0;
 	txctl->nextfraglen = 0;
 	txctl->frmlen = skb->len + FCS_LEN - (hdrlen & 3);
 	txctl->txpower = MAX_RATE_POWER; /* FIXME */
@@ -471,7 +527,7 @@ static int ath_tx_prepare(struct ath_softc *sc,
 	 * backup.
 	 *
 	 * NB: use >= to deal with sc_txintrperiod changing
-	 *     dynamically through sysctl.
+	 *     dynamically with the interrupt coalescing mode.
 	 */
 	spin_lock_bh(&txq->axq_lock);
 	if ((++txq->axq_intrcnt >= sc->sc_txintrperiod)) {
@@ -492,6 +548,164 @@ static int ath_tx_prepare(struct ath_softc *sc,
 	return 0;
 }
 
+/*
+ * Tx buffer pool.
+ *
+ * sc_txbuf is the shared pool behind sc_txbuflock. In front of it each
+ * cpu keeps a small cache of free ath_buf, so the common get/put only
+ * takes that cache's lock, which nobody else contends for. An empty
+ * cache refills and an overfull one spills in batches of
+ * sc_txbufcache_batch, paying for one shared lock round per batch.
+ * When the shared pool is dry too, the free buffers are parked in
+ * other cpus' caches and half of one is taken over.
+ *
+ * Lock order: cache lock, then sc_txbuflock; no two cache locks are
+ * held at once.
+ */
+
+static int ath_txbuf_steal(struct ath_softc *sc,
+			   struct ath_txbuf_cache *self,
+			   struct list_head *head)
+{
+	struct ath_txbuf_cache *tc;
+	int cpu, n, take;
+
+	for_each_possible_cpu(cpu) {
+		tc = per_cpu_ptr(sc->sc_txbufcache, cpu);
+		if (tc == self || !tc->count)
+			continue;
+
+		spin_lock(&tc->lock);
+		take = (tc->count + 1) / 2;
+		for (n = 0; n < take; n++)
+			list_move_tail(tc->free.next, head);
+		tc->count -= take;
+		spin_unlock(&tc->lock);
+
+		if (take)
+			return take;
+	}
+	return 0;
+}
+
+static struct ath_buf *ath_txbuf_get(struct ath_softc *sc)
+{
+	struct ath_txbuf_cache *tc;
+	struct ath_buf *bf = NULL;
+	LIST_HEAD(batch);
+	int n;
+
+	local_bh_disable();
+	tc = per_cpu_ptr(sc->sc_txbufcache, smp_processor_id());
+
+	spin_lock(&tc->lock);
+	if (likely(tc->count)) {
+		tc->hits++;
+		goto out;
+	}
+	spin_unlock(&tc->lock);
+
+	/* local cache empty, take a batch from the shared pool */
+	spin_lock(&sc->sc_txbuflock);
+	for (n = 0; n <= sc->sc_txbufcache_batch; n++) {
+		if (list_empty(&sc->sc_txbuf))
+			break;
+		list_move_tail(sc->sc_txbuf.next, &batch);
+	}
+	spin_unlock(&sc->sc_txbuflock);
+
+	if (n == 0)
+		n = ath_txbuf_steal(sc, tc, &batch);
+
+	spin_lock(&tc->lock);
+	list_splice_tail_init(&batch, &tc->free);
+	tc->count += n;
+	if (!tc->count)
+		goto done;
+	tc->steals++;
+out:
+	bf = list_first_entry(&tc->free, struct ath_buf, list);
+	list_del(&bf->list);
+	tc->count--;
+done:
+	spin_unlock(&tc->lock);
+	local_bh_enable();
+	return bf;
+}
+
+/* Return a list of ath_buf to this cpu's cache, spilling the excess */
+
+static void ath_txbuf_put_list(struct ath_softc *sc, struct list_head *head)
+{
+	struct ath_txbuf_cache *tc;
+	struct list_head *pos;
+	int n;
+
+	if (list_empty(head))
+		return;
+
+	local_bh_disable();
+	tc = per_cpu_ptr(sc->sc_txbufcache, smp_processor_id());
+
+	spin_lock(&tc->lock);
+	list_for_each(pos, head)
+		tc->count++;
+	list_splice_tail_init(head, &tc->free);
+
+	if (tc->count > sc->sc_txbufcache_max) {
+		spin_lock(&sc->sc_txbuflock);
+		for (n = tc->count - sc->sc_txbufcache_batch; n > 0; n--) {
+			list_move_tail(tc->free.next, &sc->sc_txbuf);
+			tc->count--;
+		}
+		spin_unlock(&sc->sc_txbuflock);
+	}
+	spin_unlock(&tc->lock);
+	local_bh_enable();
+}
+
+static void ath_txbuf_put(struct ath_softc *sc, struct ath_buf *bf)
+{
+	struct list_head head;
+
+	INIT_LIST_HEAD(&head);
+	list_add_tail(&bf->list, &head);
+	ath_txbuf_put_list(sc, &head);
+}
+
+/*
+ * Size the per-cpu caches from the pool. Normally at most a quarter of
+ * the buffers sit in caches; with many possible cpus each cache still
+ * holds one, and a cpu that runs dry steals from the others.
+ */
+
+static int ath_txbuf_cache_init(struct ath_softc *sc, int nbufs)
+{
+	struct ath_txbuf_cache *tc;
+	int cpu, max;
+
+	sc->sc_txbufcache = alloc_percpu(struct ath_txbuf_cache);
+	if (sc->sc_txbufcache == NULL)
+		return -ENOMEM;
+
+	max = nbufs / (4 * num_possible_cpus());
+	if (max > ATH_TXBUF_CACHE_MAX)
+		max = ATH_TXBUF_CACHE_MAX;
+	if (max < 1)
+		max = 1;
+	sc->sc_txbufcache_max = max;
+	sc->sc_txbufcache_batch = max / 2;
+
+	for_each_possible_cpu(cpu) {
+		tc = per_cpu_ptr(sc->sc_txbufcache, cpu);
+		spin_lock_init(&tc->lock);
+		INIT_LIST_HEAD(&tc->free);
+		tc->count = 0;
+		tc->hits = tc->steals = 0;
+	}
+	return 0;
+}
+
 /* To complete a chain of buffers associated a frame */
 
 static void ath_tx_complete_buf(struct ath_softc *sc,
@@ -502,6 +716,7 @@ static void ath_tx_complete_buf(struct ath_softc *sc,
 	struct sk_buff *skb = bf->bf_mpdu;
 	struct ath_xmit_status tx_status;
 	dma_addr_t *pa;
+	int i;
 
 	/*
 	 * Set retry information.
@@ -524,17 +739,23 @@ static void ath_tx_complete_buf(struct ath_softc *sc,
 	pa = get_dma_mem_context(bf, bf_dmacontext);
 	pci_unmap_single(sc->pdev,
 			 *pa,
-			 skb->len,
+			 skb_headlen(skb),
 			 PCI_DMA_TODEVICE);
+	for (i = 0; i < bf->bf_nfrags; i++)
+		pci_unmap_page(sc->pdev,
+			       bf->bf_fragaddr[i],
+			       skb_shinfo(skb)->frags[i].size,
+			       PCI_DMA_TODEVICE);
+	if (bf->bf_isdata)
+		ath9k_debug_txlat(sc, bf);
+
 	/* complete this frame */
 	ath_tx_complete(sc, skb, &tx_status, bf->bf_node);
 
 	/*
 	 * Return the list of ath_buf of this mpdu to free queue
 	 */
-	spin_lock_bh(&sc->sc_txbuflock);
-	list_splice_tail_init(bf_q, &sc->sc_txbuf);
-	spin_unlock_bh(&sc->sc_txbuflock);
+	ath_txbuf_put_list(sc, bf_q);
 }
 
 /*
@@ -645,6 +866,38 @@ static int ath_tx_num_badfrms(struct ath_softc *sc,
 	return nbad;
 }
 
+/*
+ * Adapt the aggregate size of a TID to the subframe error rate reported
+ * by block-acks: halve it when the averaged PER is high and grow it by
+ * one subframe while the link is clean.
+ * NB: must be called with txq lock held
+ */
+
+static void ath_tx_aggr_adapt(struct ath_softc *sc,
+	struct ath_buf *bf, int nbad)
+{
+	struct ath_node *an = bf->bf_node;
+	struct ath_atx_tid *tid;
+	int per;
+
+	if ((an->an_flags & ATH_NODE_CLEAN) || !bf->bf_nframes)
+		return;
+
+	tid = ATH_AN_2_TID(an, bf->bf_tidno);
+
+	per = (nbad * 256) / bf->bf_nframes;
+	tid->aggr_per += (per - tid->aggr_per) / 8;
+
+	if (tid->aggr_per > ATH_AGGR_PER_HIGH) {
+		tid->aggr_max = max(tid->aggr_max / 2, ATH_AGGR_MIN_SUBFRAMES);
+		/* start over between the thresholds at the new size */
+		tid->aggr_per = (ATH_AGGR_PER_HIGH + ATH_AGGR_PER_LOW) / 2;
+	} else if (tid->aggr_per < ATH_AGGR_PER_LOW &&
+		   tid->aggr_max < ATH_AMPDU_SUBFRAME_DEFAULT) {
+		tid->aggr_max++;
+	}
+}
+
 static void ath_tx_set_retry(struct ath_softc *sc, struct ath_buf *bf)
 {
 	struct sk_buff *skb;
@@ -693,9 +946,10 @@ static u_int32_t ath_pkt_duration(struct ath_softc *sc,
 				  enum hal_bool shortPreamble)
 {
 	const struct hal_rate_table *rt = sc->sc_currates;
-	u_int32_t nbits, nsymbits, duration, nsymbols;
+	const struct ath_ht_rate_dur *hd;
+	u_int32_t nbits, duration, nsymbols;
 	u_int8_t rc;
-	int streams, pktlen;
+	int pktlen;
 
 	pktlen = bf->bf_isaggr ? bf->bf_al : bf->bf_frmlen;
 	rc = rt->info[rix].rateCode;
@@ -712,9 +966,9 @@ static u_int32_t ath_pkt_duration(struct ath_softc *sc,
 	/*
 	 * find number of symbols: PLCP + data
 	 */
+	hd = &sc->sc_htdur[HT_RC_2_MCS(rc)];
 	nbits = (pktlen << 3) + OFDM_PLCP_BITS;
-	nsymbits = bits_per_symbol[HT_RC_2_MCS(rc)][width];
-	nsymbols = (nbits + nsymbits - 1) / nsymbits;
+	nsymbols = ATH_HT_NSYMBOLS(hd, width, nbits);
 
 	if (!half_gi)
 		duration = SYMBOL_TIME(nsymbols);
@@ -724,9 +978,36 @@ static u_int32_t ath_pkt_duration(struct ath_softc *sc,
 	/*
 	 * addup duration for legacy/ht training and signal fields
 	 */
-	streams = HT_RC_2_STREAMS(rc);
-	duration += L_STF + L_LTF + L_SIG + HT_SIG + HT_STF + HT_LTF(streams);
-	return duration;
+	return duration + hd->preamble;
+}
+
+/*
+ * Air time, in usec, used by a completed transmit unit: every attempt
+ * made at each rate series up to and including the final one.
+ */
+
+static u_int32_t ath_tx_airtime(struct ath_softc *sc,
+				struct ath_buf *bf,
+				struct ath_desc *ds)
+{
+	int final = min_t(int, ds->ds_txstat.ts_rateindex, 3);
+	u_int32_t airtime = 0;
+	int i, tries;
+
+	for (i = 0; i <= final; i++) {
+		if (i < final)
+			tries = bf->bf_rcs[i].tries;
+		else
+			tries = ds->ds_txstat.ts_longretry + 1;
+
+		airtime += tries * ath_pkt_duration(sc,
+			bf->bf_rcs[i].rix, bf,
+			(bf->bf_rcs[i].flags & ATH_RC_CW40_FLAG) != 0,
+			(bf->bf_rcs[i].flags & ATH_RC_SGI_FLAG),
+			bf->bf_shpreamble);
+	}
+
+	return airtime;
 }
 
 /* Rate module function to set rate related fields in tx descriptor */
@@ -958,6 +1239,7 @@ static int ath_tx_send_normal(struct ath_softc *sc,
 
 	bf = list_first_entry(bf_head, struct ath_buf, list);
 	bf->bf_isampdu = 0; /* regular HT frame */
+	ath_txlat_stamp(bf, ATH_TXLAT_DEQ);
 
 	skb = (struct sk_buff *)bf->bf_mpdu;
 	tx_info = IEEE80211_SKB_CB(skb);
@@ -1054,6 +1336,19 @@ static void ath_tx_complete_aggr_rifs(struct ath_softc *sc,
 		}
 	}
 
+	/*
+	 * charge the node/ac for the air time of this unit, the
+	 * deficit scheduler uses it to pick the next destination
+	 */
+	if (sc->sc_config.airtime_fair && !isnodegone) {
+		u_int32_t airtime = ath_tx_airtime(sc, bf, ds);
+
+		spin_lock_bh(&txq->axq_lock);
+		tid->ac->airtime_deficit -= airtime;
+		tid->ac->airtime_used += airtime;
+		spin_unlock_bh(&txq->axq_lock);
+	}
+
 	INIT_LIST_HEAD(&bf_pending);
 	INIT_LIST_HEAD(&bf_head);
 
@@ -1145,12 +1440,8 @@ static void ath_tx_complete_aggr_rifs(struct ath_softc *sc,
 				struct ath_buf *tbf;
 
 				/* allocate new descriptor */
-				spin_lock_bh(&sc->sc_txbuflock);
-				ASSERT(!list_empty((&sc->sc_txbuf)));
-				tbf = list_first_entry(&sc->sc_txbuf,
-						struct ath_buf, list);
-				list_del(&tbf->list);
-				spin_unlock_bh(&sc->sc_txbuflock);
+				tbf = ath_txbuf_get(sc);
+				ASSERT(tbf != NULL);
 
 				ATH_TXBUF_RESET(tbf);
 
@@ -1340,9 +1631,7 @@ static int ath_tx_processq(struct ath_softc *sc, struct ath_txq *txq)
 
 		if (bf_held) {
 			list_del(&bf_held->list);
-			spin_lock_bh(&sc->sc_txbuflock);
-			list_add_tail(&bf_held->list, &sc->sc_txbuf);
-			spin_unlock_bh(&sc->sc_txbuflock);
+			ath_txbuf_put(sc, bf_held);
 		}
 
 		if (txok) {
@@ -1360,6 +1649,11 @@ static int ath_tx_processq(struct ath_softc *sc, struct ath_txq *txq)
 			nbad = 0;
 		} else {
 			nbad = ath_tx_num_badfrms(sc, bf, txok);
+			if (sc->sc_config.aggr_adapt) {
+				spin_lock_bh(&txq->axq_lock);
+				ath_tx_aggr_adapt(sc, bf, nbad);
+				spin_unlock_bh(&txq->axq_lock);
+			}
 		}
 		skb = bf->bf_mpdu;
 		tx_info = IEEE80211_SKB_CB(skb);
@@ -1427,9 +1721,13 @@ static void ath_tx_stopdma(struct ath_softc *sc, struct ath_txq *txq)
 		ath9k_hw_gettxbuf(ah, txq->axq_qnum), txq->axq_link);
 }
 
-/* Drain only the data queues */
+/*
+ * Stop tx DMA on the data queues. If the hardware still owns
+ * descriptors afterwards the chip is reset, so that the buffers can
+ * be reclaimed safely.
+ */
 
-static void ath_drain_txdataq(struct ath_softc *sc, enum hal_bool retry_tx)
+static void ath_tx_stopdma_data(struct ath_softc *sc)
 {
 	struct ath_hal *ah = sc->sc_ah;
 	int i;
@@ -1470,6 +1768,15 @@ static void ath_drain_txdataq(struct ath_softc *sc, enum hal_bool retry_tx)
 		}
 		spin_unlock_bh(&sc->sc_resetlock);
 	}
+}
+
+/* Drain only the data queues */
+
+static void ath_drain_txdataq(struct ath_softc *sc, enum hal_bool retry_tx)
+{
+	int i;
+
+	ath_tx_stopdma_data(sc);
 
 	for (i = 0; i < HAL_NUM_TX_QUEUES; i++) {
 		if (ATH_TXQ_SETUP(sc, i))
@@ -1501,6 +1808,218 @@ static void ath_tx_addto_baw(struct ath_softc *sc,
 	}
 }
 
+static void ath_tx_setup_buffer(struct ath_softc *sc,
+				struct list_head *bf_head,
+				struct sk_buff *skb,
+				struct scatterlist *sg,
+				u_int32_t n_sg,
+				struct ath_tx_control *txctl);
+
+/*
+ * Append the MSDU of skb to an A-MSDU as one subframe: DA, SA and
+ * length, then the payload.  hdrpad is the offset of the payload.
+ */
+
+static void ath_tx_amsdu_put(struct sk_buff *amsdu,
+			     struct sk_buff *skb,
+			     int hdrpad)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	int len = skb->len - hdrpad;
+	u8 *pos;
+
+	pos = skb_put(amsdu, ATH_AMSDU_SUBHDR_LEN + len);
+	memcpy(pos, ieee80211_get_DA(hdr), ETH_ALEN);
+	memcpy(pos + ETH_ALEN, ieee80211_get_SA(hdr), ETH_ALEN);
+	*(__be16 *)(pos + 2 * ETH_ALEN) = cpu_to_be16(len);
+	memcpy(pos + ATH_AMSDU_SUBHDR_LEN, skb->data + hdrpad, len);
+}
+
+/*
+ * Turn the MPDU header at the start of amsdu into an A-MSDU carrier:
+ * set the A-MSDU present bit and, since DA/SA now travel in the
+ * subframe headers, put the BSSID into addr3.
+ */
+
+static void ath_tx_amsdu_hdr(struct sk_buff *amsdu)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)amsdu->data;
+	u8 *qc;
+
+	qc = ieee80211_get_qos_ctl(hdr);
+	qc[0] |= ATH_QOS_AMSDU_PRESENT;
+
+	if (ieee80211_has_tods(hdr->frame_control))
+		memcpy(hdr->addr3, hdr->addr1, ETH_ALEN);
+	else if (ieee80211_has_fromds(hdr->frame_control))
+		memcpy(hdr->addr3, hdr->addr2, ETH_ALEN);
+}
+
+/*
+ * Try to fold a small frame into the MPDU at the tail of the tid queue,
+ * turning that one into an A-MSDU if it is not one already.  The tail
+ * must be the frame sent just before this one, still untried, so both
+ * sequence numbers are contiguous and the BAW never saw either.
+ *
+ * On success the frame, its ath_bufs and its sequence number are gone
+ * and 0 is returned.  Absorbed frames get no tx status of their own,
+ * so frames that asked for one are never packed; neither are TKIP and
+ * WEP frames, whose MIC/IV would have to be rebuilt over the A-MSDU,
+ * nor four-address frames.  Both MSDUs must be small.
+ *
+ * NB: must be called with txq lock held
+ */
+
+static int ath_tx_pack_amsdu(struct ath_softc *sc,
+			     struct ath_atx_tid *tid,
+			     struct list_head *bf_head,
+			     struct ath_tx_control *txctl)
+{
+	struct ath_buf *bf, *tbf, *nbf;
+	struct sk_buff *skb, *tskb, *amsdu;
+	struct ieee80211_tx_info *tx_info, *ttx_info;
+	struct ieee80211_hdr *hdr;
+	struct ath_tx_control ntxctl;
+	struct scatterlist sg;
+	struct list_head nbf_head;
+	dma_addr_t *pa;
+	u_int32_t txflags = IEEE80211_TX_CTL_REQ_TX_STATUS |
+		IEEE80211_TX_CTL_RATE_CTRL_PROBE | IEEE80211_TX_CTL_NO_ACK;
+	int hdrlen, hdrpad, ivlen, len, tlen, pad, isamsdu;
+	u8 *qc;
+
+	if (!(tid->an->an_flags & ATH_NODE_AMSDU) ||
+	    list_empty(&tid->buf_q))
+		return -EINVAL;
+
+	/* the tail must be a whole, single-segment frame, never sent */
+	bf = list_first_entry(bf_head, struct ath_buf, list);
+	tbf = list_entry(tid->buf_q.prev, struct ath_buf, list);
+	if (bf->bf_lastfrm != bf || tbf->bf_lastfrm != tbf ||
+	    tbf->bf_isretried ||
+	    ((tbf->bf_seqno + 1) & (IEEE80211_SEQ_MAX - 1)) != txctl->seqno ||
+	    ((tid->seq_next - 1) & (IEEE80211_SEQ_MAX - 1)) != txctl->seqno)
+		return -EINVAL;
+
+	if (txctl->keytype != HAL_KEY_TYPE_CLEAR &&
+	    txctl->keytype != HAL_KEY_TYPE_AES)
+		return -EINVAL;
+
+	skb = (struct sk_buff *)bf->bf_mpdu;
+	tskb = (struct sk_buff *)tbf->bf_mpdu;
+	tx_info = IEEE80211_SKB_CB(skb);
+	ttx_info = IEEE80211_SKB_CB(tskb);
+	hdr = (struct ieee80211_hdr *)skb->data;
+
+	if (skb_is_nonlinear(skb) || skb_is_nonlinear(tskb) ||
+	    ((tx_info->flags | ttx_info->flags) & txflags) ||
+	    !ieee80211_is_data_qos(hdr->frame_control) ||
+	    ieee80211_has_a4(hdr->frame_control) ||
+	    tbf->bf_keytype != txctl->keytype)
+		return -EINVAL;
+
+	/* same key, same header layout */
+	hdrlen = ieee80211_get_hdrlen_from_skb(skb);
+	if (ieee80211_get_hdrlen_from_skb(tskb) != hdrlen)
+		return -EINVAL;
+	ivlen = 0;
+	if (txctl->keytype != HAL_KEY_TYPE_CLEAR) {
+		if (tx_info->control.hw_key != ttx_info->control.hw_key)
+			return -EINVAL;
+		ivlen = tx_info->control.iv_len;
+	}
+	hdrpad = hdrlen + (hdrlen & 3) + ivlen;
+
+	len = skb->len - hdrpad;
+	if (len > ATH_AMSDU_MSDU_MAX)
+		return -EINVAL;
+
+	/* A-MSDU body length before and after adding this frame */
+	qc = ieee80211_get_qos_ctl((struct ieee80211_hdr *)tskb->data);
+	isamsdu = qc[0] & ATH_QOS_AMSDU_PRESENT;
+	tlen = tskb->len - hdrpad;
+	if (!isamsdu) {
+		if (tlen > ATH_AMSDU_MSDU_MAX)
+			return -EINVAL;
+		tlen += ATH_AMSDU_SUBHDR_LEN;
+	}
+	pad = ALIGN(tlen, 4) - tlen;
+	if (tlen + pad + ATH_AMSDU_SUBHDR_LEN + len > sc->sc_ht_info.maxamsdu ||
+	    txctl->frmlen - skb->len + hdrpad + tlen + pad +
+	    ATH_AMSDU_SUBHDR_LEN + len > ATH_AMPDU_MPDU_MAX)
+		return -EINVAL;
+
+	nbf = ath_txbuf_get(sc);
+	if (unlikely(nbf == NULL))
+		return -ENOMEM;
+
+	if (isamsdu && skb_tailroom(tskb) >= pad + ATH_AMSDU_SUBHDR_LEN + len) {
+		amsdu = tskb;
+	} else {
+		/* exactly the packed length, copied again if it grows */
+		amsdu = dev_alloc_skb(hdrpad + tlen + pad +
+				      ATH_AMSDU_SUBHDR_LEN + len);
+		if (unlikely(amsdu == NULL)) {
+			ath_txbuf_put(sc, nbf);
+			return -ENOMEM;
+		}
+		memcpy(amsdu->cb, tskb->cb, sizeof(amsdu->cb));
+		skb_set_queue_mapping(amsdu, skb_get_queue_mapping(tskb));
+
+		if (isamsdu) {
+			memcpy(skb_put(amsdu, tskb->len), tskb->data,
+			       tskb->len);
+		} else {
+			memcpy(skb_put(amsdu, hdrpad), tskb->data, hdrpad);
+			ath_tx_amsdu_hdr(amsdu);
+			ath_tx_amsdu_put(amsdu, tskb, hdrpad);
+		}
+	}
+
+	/* nothing may fail past this point */
+	pa = get_dma_mem_context(tbf, bf_dmacontext);
+	pci_unmap_single(sc->pdev, *pa, tskb->len, PCI_DMA_TODEVICE);
+	if (amsdu != tskb)
+		dev_kfree_skb_any(tskb);
+
+	memset(skb_put(amsdu, pad), 0, pad);
+	ath_tx_amsdu_put(amsdu, skb, hdrpad);
+
+	/* retire the absorbed frame; the tail's node reference covers us */
+	pa = get_dma_mem_context(bf, bf_dmacontext);
+	pci_unmap_single(sc->pdev, *pa, skb->len, PCI_DMA_TODEVICE);
+	kfree(tx_info->driver_data[0]);
+	dev_kfree_skb_any(skb);
+	ath_txbuf_put_list(sc, bf_head);
+	ath_node_put(sc, txctl->an, ATH9K_BH_STATUS_CHANGE);
+	DECR(tid->seq_next, IEEE80211_SEQ_MAX);
+
+	/* requeue the A-MSDU under the tail's sequence number */
+	ntxctl = *txctl;
+	ntxctl.seqno = tbf->bf_seqno;
+	list_del(&tbf->list);
+	ath_txbuf_put(sc, tbf);
+
+	ntxctl.frmlen = txctl->frmlen - skb->len + amsdu->len;
+	ntxctl.dmacontext = pci_map_single(sc->pdev, amsdu->data, amsdu->len,
+					   PCI_DMA_TODEVICE);
+	memset(&sg, 0, sizeof(sg));
+	sg_dma_address(&sg) = ntxctl.dmacontext;
+	sg_dma_len(&sg) = amsdu->len;
+
+	INIT_LIST_HEAD(&nbf_head);
+	ATH_TXBUF_RESET(nbf);
+	list_add_tail(&nbf->list, &nbf_head);
+	ath_tx_setup_buffer(sc, &nbf_head, amsdu, &sg, 1, &ntxctl);
+	nbf->bf_isampdu = 1;
+	nbf->bf_seqno = ntxctl.seqno;
+	ath_txlat_stamp(nbf, ATH_TXLAT_ENQ);
+	list_splice_tail_init(&nbf_head, &tid->buf_q);
+
+	ath9k_debug_amsdu(sc, !isamsdu);
+	return 0;
+}
+
 /*
  * Function to send an A-MPDU
  * NB: must be called with txq lock held
@@ -1536,8 +2055,11 @@ static int ath_tx_send_ampdu(struct ath_softc *sc,
 	    txq->axq_depth >= ATH_AGGR_MIN_QDEPTH) {
 		/*
 		 * Add this frame to software queue for scheduling later
-		 * for aggregation.
+		 * for aggregation, packed into the frame ahead of it when
+		 * both are small enough.
 		 */
+		if (ath_tx_pack_amsdu(sc, tid, bf_head, txctl) == 0)
+			return 0;
 		list_splice_tail_init(bf_head, &tid->buf_q);
 		ath_tx_queue_tid(txq, tid);
 		return 0;
@@ -1637,7 +2159,7 @@ static int ath_compute_num_delims(struct ath_softc *sc,
 				  u_int16_t frmlen)
 {
 	const struct hal_rate_table *rt = sc->sc_currates;
-	u_int32_t nsymbits, nsymbols, mpdudensity;
+	u_int32_t mpdudensity;
 	u_int16_t minlen;
 	u_int8_t rc, flags, rix;
 	int width, half_gi, ndelim, mindelim;
@@ -1675,16 +2197,8 @@ static int ath_compute_num_delims(struct ath_softc *sc,
 	width = (flags & ATH_RC_CW40_FLAG) ? 1 : 0;
 	half_gi = (flags & ATH_RC_SGI_FLAG) ? 1 : 0;
 
-	if (half_gi)
-		nsymbols = NUM_SYMBOLS_PER_USEC_HALFGI(mpdudensity);
-	else
-		nsymbols = NUM_SYMBOLS_PER_USEC(mpdudensity);
-
-	if (nsymbols == 0)
-		nsymbols = 1;
-
-	nsymbits = bits_per_symbol[HT_RC_2_MCS(rc)][width];
-	minlen = (nsymbols * nsymbits) / BITS_PER_BYTE;
+	minlen = sc->sc_htdur[HT_RC_2_MCS(rc)].minlen
+		[ATH_MPDUDENSITY_IDX(mpdudensity)][width][half_gi];
 
 	/* Is frame shorter than required minimum length? */
 	if (frmlen < minlen) {
@@ -1696,6 +2210,53 @@ static int ath_compute_num_delims(struct ath_softc *sc,
 	return ndelim;
 }
 
+/*
+ * Precompute the per-MCS HT airtime constants used by ath_pkt_duration()
+ * and ath_compute_num_delims(), so neither divides per frame. They only
+ * depend on MCS, channel width and guard interval, hence one table for
+ * all HT rate tables; built once at attach.
+ */
+
+static void ath_tx_rate_setup(struct ath_softc *sc)
+{
+	struct ath_ht_rate_dur *hd;
+	u_int32_t nsymbits, nsymbols, usec;
+	int mcs, width, half_gi, i;
+
+	for (mcs = 0; mcs < ATH_HT_MCS_MAX; mcs++) {
+		hd = &sc->sc_htdur[mcs];
+		hd->preamble = L_STF + L_LTF + L_SIG + HT_SIG + HT_STF +
+			HT_LTF((mcs >> 3) + 1);
+
+		for (width = 0; width < 2; width++) {
+			nsymbits = bits_per_symbol[mcs][width];
+			hd->symbits[width] = nsymbits;
+			hd->symrecip[width] = (u_int32_t)
+				div64_u64((1ULL << 32) + nsymbits - 1,
+					  nsymbits);
+
+			/* index 0 is "no restriction", then 1, 2 .. 16 us */
+			for (i = 0; i < ATH_MPDUDENSITY_NUM; i++) {
+				usec = i ? 1 << (i - 1) : 0;
+				for (half_gi = 0; half_gi < 2; half_gi++) {
+					if (half_gi)
+						nsymbols =
+						NUM_SYMBOLS_PER_USEC_HALFGI(usec);
+					else
+						nsymbols =
+						NUM_SYMBOLS_PER_USEC(usec);
+					if (nsymbols == 0)
+						nsymbols = usec ? 1 : 0;
+
+					hd->minlen[i][width][half_gi] =
+						(nsymbols * nsymbits) /
+						BITS_PER_BYTE;
+				}
+			}
+		}
+	}
+}
+
 /*
  * For aggregation from software buffer queue.
  * NB: must be called with txq lock held
@@ -1734,7 +2295,9 @@ static enum ATH_AGGR_STATUS ath_tx_form_aggr(struct ath_softc *sc,
 		}
 
 		if (!rl) {
-			aggr_limit = ath_lookup_rate(sc, bf);
+			/* scale the byte limit with the adapted size */
+			aggr_limit = ath_lookup_rate(sc, bf) * tid->aggr_max /
+				ATH_AMPDU_SUBFRAME_DEFAULT;
 			rl = 1;
 			/*
 			 * Is rate dual stream
@@ -1758,7 +2321,7 @@ static enum ATH_AGGR_STATUS ath_tx_form_aggr(struct ath_softc *sc,
 		 * do not exceed subframe limit
 		 */
 		if ((nframes + *prev_frames) >=
-		    min((int)h_baw, ATH_AMPDU_SUBFRAME_DEFAULT)) {
+		    min((int)h_baw, tid->aggr_max)) {
 			status = ATH_AGGR_LIMITED;
 			break;
 		}
@@ -1788,6 +2351,7 @@ static enum ATH_AGGR_STATUS ath_tx_form_aggr(struct ath_softc *sc,
 		 */
 		list_cut_position(&bf_head, &tid->buf_q, &bf->bf_lastfrm->list);
 		ath_tx_addto_baw(sc, tid, bf);
+		ath_txlat_stamp(bf, ATH_TXLAT_DEQ);
 
 		list_for_each_entry(tbf, &bf_head, list) {
 			ath9k_hw_set11n_aggr_middle(sc->sc_ah,
@@ -1837,6 +2401,7 @@ static void ath_tx_sched_aggr(struct ath_softc *sc,
 	struct list_head bf_q;
 	struct aggr_rifs_param param = {0, 0, 0, 0, NULL};
 	int prev_frames = 0;
+	cycles_t start;
 
 	do {
 		if (list_empty(&tid->buf_q))
@@ -1844,6 +2409,7 @@ static void ath_tx_sched_aggr(struct ath_softc *sc,
 
 		INIT_LIST_HEAD(&bf_q);
 
+		start = ath9k_debug_cycles();
 		status = ath_tx_form_aggr(sc, tid, &bf_q, &bf_lastaggr, &param,
 					  &prev_frames);
 
@@ -1855,6 +2421,7 @@ static void ath_tx_sched_aggr(struct ath_softc *sc,
 			break;
 
 		bf = list_first_entry(&bf_q, struct ath_buf, list);
+		ath9k_debug_aggr(sc, bf->bf_nframes, ath9k_debug_cycles() - start);
 		bf_last = list_entry(bf_q.prev, struct ath_buf, list);
 		bf->bf_lastbf = bf_last;
 
@@ -1983,40 +2550,34 @@ static void ath_txq_drain_pending_buffers(struct ath_softc *sc,
 	}
 }
 
-static int ath_tx_start_dma(struct ath_softc *sc,
-			    struct sk_buff *skb,
-			    struct scatterlist *sg,
-			    u_int32_t n_sg,
-			    struct ath_tx_control *txctl)
+/*
+ * Fill in the ath_bufs on bf_head, one per sglist entry, for a mapped
+ * frame.  The buffers must already be reset.
+ */
+
+static void ath_tx_setup_buffer(struct ath_softc *sc,
+				struct list_head *bf_head,
+				struct sk_buff *skb,
+				struct scatterlist *sg,
+				u_int32_t n_sg,
+				struct ath_tx_control *txctl)
 {
 	struct ath_node *an = txctl->an;
-	struct ath_buf *bf = NULL;
-	struct list_head bf_head;
+	struct ath_buf *bf;
 	struct ath_desc *ds;
 	struct ath_hal *ah = sc->sc_ah;
-	struct ath_txq *txq = &sc->sc_txq[txctl->qnum];
 	struct ath_tx_info_priv *tx_info_priv;
 	struct ath_rc_series *rcs;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
 	struct ieee80211_tx_info *tx_info =  IEEE80211_SKB_CB(skb);
+	struct ath_buf *bf_seg, *bf_prev;
+	struct skb_frag_struct *frag;
 	__le16 fc = hdr->frame_control;
+	int i;
 
-	/* For each sglist entry, allocate an ath_buf for DMA */
-	INIT_LIST_HEAD(&bf_head);
-	spin_lock_bh(&sc->sc_txbuflock);
-	if (unlikely(list_empty(&sc->sc_txbuf))) {
-		spin_unlock_bh(&sc->sc_txbuflock);
-		return -ENOMEM;
-	}
-
-	bf = list_first_entry(&sc->sc_txbuf, struct ath_buf, list);
-	list_del(&bf->list);
-	spin_unlock_bh(&sc->sc_txbuflock);
-
-	list_add_tail(&bf->list, &bf_head);
+	bf = list_first_entry(bf_head, struct ath_buf, list);
 
 	/* set up this buffer */
-	ATH_TXBUF_RESET(bf);
 	bf->bf_frmlen = txctl->frmlen;
 	bf->bf_isdata = ieee80211_is_data(fc);
 	bf->bf_isbar = ieee80211_is_back_req(fc);
@@ -2024,6 +2585,7 @@ static int ath_tx_start_dma(struct ath_softc *sc,
 	bf->bf_flags = txctl->flags;
 	bf->bf_shpreamble = sc->sc_flags & ATH_PREAMBLE_SHORT;
 	bf->bf_keytype = txctl->keytype;
+	bf->bf_tidno = txctl->tidno;
 	tx_info_priv = (struct ath_tx_info_priv *)tx_info->driver_data[0];
 	rcs = tx_info_priv->rcs;
 	bf->bf_rcs[0] = rcs[0];
@@ -2038,6 +2600,7 @@ static int ath_tx_start_dma(struct ath_softc *sc,
 	ds = bf->bf_desc;
 	ds->ds_link = 0;
 	ds->ds_data = bf->bf_buf_addr;
+	ds->ds_vdata = skb->data;
 
 	/*
 	 * Save the DMA context in the first ath_buf
@@ -2062,10 +2625,79 @@ static int ath_tx_start_dma(struct ath_softc *sc,
 			    AH_TRUE,            /* first segment */
 			    (n_sg == 1) ? AH_TRUE : AH_FALSE, /* last segment */
 			    ds);                /* first descriptor */
-	ath_desc_swap(ds);
 
-	bf->bf_lastfrm = bf;
+	/*
+	 * Chain one descriptor per page fragment behind the head.  Only
+	 * the first ath_buf carries the frame state; it also remembers
+	 * the fragment mappings so completion can undo them.
+	 */
+	bf_prev = bf;
+	bf->bf_nfrags = n_sg - 1;
+	for (i = 1; i < n_sg; i++) {
+		bf_seg = list_entry(bf_prev->list.next, struct ath_buf, list);
+		frag = &skb_shinfo(skb)->frags[i - 1];
+
+		bf_seg->bf_mpdu = skb;
+		bf_seg->bf_node = an;
+		bf_seg->bf_buf_addr = sg_dma_address(&sg[i]);
+		bf->bf_fragaddr[i - 1] = bf_seg->bf_buf_addr;
+
+		bf_seg->bf_desc->ds_link = 0;
+		bf_seg->bf_desc->ds_data = bf_seg->bf_buf_addr;
+		bf_seg->bf_desc->ds_vdata =
+			page_address(frag->page) + frag->page_offset;
+		ath9k_hw_filltxdesc(ah,
+				    bf_seg->bf_desc,
+				    sg_dma_len(&sg[i]),
+				    AH_FALSE,
+				    (i == n_sg - 1) ? AH_TRUE : AH_FALSE,
+				    ds);
+
+		bf_prev->bf_desc->ds_link = bf_seg->bf_daddr;
+		bf_prev = bf_seg;
+	}
+	list_for_each_entry(bf_seg, bf_head, list)
+		ath_desc_swap(bf_seg->bf_desc);
+
+	bf->bf_lastfrm = bf_prev;
 	bf->bf_ht = txctl->ht;
+}
+
+static int ath_tx_start_dma(struct ath_softc *sc,
+			    struct sk_buff *skb,
+			    struct scatterlist *sg,
+			    u_int32_t n_sg,
+			    struct ath_tx_control *txctl)
+{
+	struct ath_node *an = txctl->an;
+	struct ath_buf *bf;
+	struct list_head bf_head;
+	struct ath_txq *txq = &sc->sc_txq[txctl->qnum];
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct ath_buf *bf_seg;
+	__le16 fc = hdr->frame_control;
+	int i;
+
+	/* For each sglist entry, allocate an ath_buf for DMA */
+	INIT_LIST_HEAD(&bf_head);
+	for (i = 0; i < n_sg; i++) {
+		bf_seg = ath_txbuf_get(sc);
+		if (unlikely(bf_seg == NULL)) {
+			ath_txbuf_put_list(sc, &bf_head);
+			return -ENOMEM;
+		}
+		ATH_TXBUF_RESET(bf_seg);
+		list_add_tail(&bf_seg->list, &bf_head);
+	}
+	ath_tx_setup_buffer(sc, &bf_head, skb, sg, n_sg, txctl);
+	bf = list_first_entry(&bf_head, struct ath_buf, list);
+
+	/*
+	 * Frames that bypass the tid queue leave it the moment they
+	 * arrive; the schedulers restamp ATH_TXLAT_DEQ otherwise.
+	 */
+	ath_txlat_stamp(bf, ATH_TXLAT_ENQ);
+	ath_txlat_stamp(bf, ATH_TXLAT_DEQ);
 
 	spin_lock_bh(&txq->axq_lock);
 
@@ -2085,7 +2717,7 @@ static int ath_tx_start_dma(struct ath_softc *sc,
 			ath_tx_send_normal(sc, txq, tid, &bf_head);
 		}
 	} else {
-		bf->bf_lastbf = bf;
+		bf->bf_lastbf = bf->bf_lastfrm;
 		bf->bf_nframes = 1;
 		ath_buf_set_rate(sc, bf);
 
@@ -2128,20 +2760,38 @@ static void xmit_map_sg(struct ath_softc *sc,
 {
 	struct ath_xmit_status tx_status;
 	struct ath_atx_tid *tid;
-	struct scatterlist sg;
-
-	*pa = pci_map_single(sc->pdev, skb->data, skb->len, PCI_DMA_TODEVICE);
+	struct scatterlist sg[ATH_TX_MAXSEGS];
+	struct skb_frag_struct *frag;
+	int i, n_sg = skb_shinfo(skb)->nr_frags + 1;
+
+	*pa = pci_map_single(sc->pdev, skb->data, skb_headlen(skb),
+			     PCI_DMA_TODEVICE);
+
+	/* setup S/G list: the linear head, then one entry per page */
+	memset(sg, 0, n_sg * sizeof(struct scatterlist));
+	sg_dma_address(&sg[0]) = *pa;
+	sg_dma_len(&sg[0]) = skb_headlen(skb);
+	for (i = 1; i < n_sg; i++) {
+		frag = &skb_shinfo(skb)->frags[i - 1];
+		sg_dma_address(&sg[i]) = pci_map_page(sc->pdev, frag->page,
+						      frag->page_offset,
+						      frag->size,
+						      PCI_DMA_TODEVICE);
+		sg_dma_len(&sg[i]) = frag->size;
+	}
 
-	/* setup S/G list */
-	memset(&sg, 0, sizeof(struct scatterlist));
-	sg_dma_address(&sg) = *pa;
-	sg_dma_len(&sg) = skb->len;
+	if (n_sg > 1)
+		ath9k_debug_txsg(sc, n_sg, 0);
 
-	if (ath_tx_start_dma(sc, skb, &sg, 1, txctl) != 0) {
+	if (ath_tx_start_dma(sc, skb, sg, n_sg, txctl) != 0) {
 		/*
 		 *  We have to do drop frame here.
 		 */
-		pci_unmap_single(sc->pdev, *pa, skb->len, PCI_DMA_TODEVICE);
+		pci_unmap_single(sc->pdev, *pa, skb_headlen(skb),
+				 PCI_DMA_TODEVICE);
+		for (i = 1; i < n_sg; i++)
+			pci_unmap_page(sc->pdev, sg_dma_address(&sg[i]),
+				       sg_dma_len(&sg[i]), PCI_DMA_TODEVICE);
 
 		tx_status.retries = 0;
 		tx_status.flags = ATH_TX_ERROR;
@@ -2162,6 +2812,8 @@ int ath_tx_init(struct ath_softc *sc, int nbufs)
 {
 	int error = 0;
 
+	ath_tx_rate_setup(sc);
+
 	do {
 		spin_lock_init(&sc->sc_txbuflock);
 
@@ -2175,6 +2827,14 @@ int ath_tx_init(struct ath_softc *sc, int nbufs)
 			break;
 		}
 
+		error = ath_txbuf_cache_init(sc, nbufs * ATH_FRAG_PER_MSDU);
+		if (error != 0) {
+			DPRINTF(sc, ATH_DEBUG_FATAL,
+				"%s: failed to allocate tx buffer caches\n",
+				__func__);
+			break;
+		}
+
 		/* XXX allocate beacon state together with vap */
 		error = ath_descdma_setup(sc, &sc->sc_bdma, &sc->sc_bbuf,
 					  "beacon", ATH_BCBUF, 1);
@@ -2202,7 +2862,11 @@ int ath_tx_cleanup(struct ath_softc *sc)
 	if (sc->sc_bdma.dd_desc_len != 0)
 		ath_descdma_cleanup(sc, &sc->sc_bdma, &sc->sc_bbuf);
 
-	/* cleanup tx descriptors */
+	/* cleanup tx descriptors, cached buffers live in the same block */
+	if (sc->sc_txbufcache != NULL) {
+		free_percpu(sc->sc_txbufcache);
+		sc->sc_txbufcache = NULL;
+	}
 	if (sc->sc_txdma.dd_desc_len != 0)
 		ath_descdma_cleanup(sc, &sc->sc_txdma, &sc->sc_txbuf);
 
@@ -2272,6 +2936,10 @@ struct ath_txq *ath_txq_setup(struct ath_softc *sc, int qtype, int subtype)
 		txq->axq_totalqueued = 0;
 		txq->axq_intrcnt = 0;
 		txq->axq_linkbuf = NULL;
+		txq->axq_batch = 0;
+		txq->axq_kickframes = 0;
+		txq->axq_txdpbuf = NULL;
+		INIT_LIST_HEAD(&txq->axq_held);
 		sc->sc_txqsetup |= 1<<qnum;
 	}
 	return &sc->sc_txq[qnum];
@@ -2407,6 +3075,20 @@ int ath_tx_start(struct ath_softc *sc, struct sk_buff *skb)
 	struct ath_tx_control txctl;
 	int error = 0;
 
+	/*
+	 * Page fragments are handed to the hardware one descriptor each.
+	 * Fall back to a single copy when there are more of them than we
+	 * chain per frame, for frag lists, or when asked to.
+	 */
+	if (skb_is_nonlinear(skb) &&
+	    (sc->sc_config.tx_linearize ||
+	     skb_shinfo(skb)->frag_list != NULL ||
+	     skb_shinfo(skb)->nr_frags >= ATH_TX_MAXSEGS)) {
+		if (skb_linearize(skb) != 0)
+			return -ENOMEM;
+		ath9k_debug_txsg(sc, 1, 1);
+	}
+
 	error = ath_tx_prepare(sc, skb, &txctl);
 	if (error == 0)
 		/*
@@ -2443,9 +3125,12 @@ void ath_tx_tasklet(struct ath_softc *sc)
 	}
 	if (nacked)
 		sc->sc_lastrx = tsf;
+	sc->sc_intrcoal.wframes += nacked;
 }
 
-void ath_tx_draintxq(struct ath_softc *sc,
+/* Complete everything on the hardware queue, sent or not */
+
+static void ath_tx_drainhwq(struct ath_softc *sc,
 	struct ath_txq *txq, enum hal_bool retry_tx)
 {
 	struct ath_buf *bf, *lastbf;
@@ -2473,9 +3158,7 @@ void ath_tx_draintxq(struct ath_softc *sc,
 			list_del(&bf->list);
 			spin_unlock_bh(&txq->axq_lock);
 
-			spin_lock_bh(&sc->sc_txbuflock);
-			list_add_tail(&bf->list, &sc->sc_txbuf);
-			spin_unlock_bh(&sc->sc_txbuflock);
+			ath_txbuf_put(sc, bf);
 			continue;
 		}
 
@@ -2494,6 +3177,12 @@ void ath_tx_draintxq(struct ath_softc *sc,
 		else
 			ath_tx_complete_buf(sc, bf, &bf_head, 0, 0);
 	}
+}
+
+void ath_tx_draintxq(struct ath_softc *sc,
+	struct ath_txq *txq, enum hal_bool retry_tx)
+{
+	ath_tx_drainhwq(sc, txq, retry_tx);
 
 	/* flush any pending frames if aggregation is enabled */
 	if (sc->sc_txaggr) {
@@ -2521,6 +3210,239 @@ void ath_draintxq(struct ath_softc *sc, enum hal_bool retry_tx)
 	ath_drain_txdataq(sc, retry_tx);
 }
 
+/*
+ * Off-channel tx hold.
+ *
+ * Leaving the channel for a scan would otherwise fail every frame the
+ * hardware has not sent yet and every aggregate waiting on a TID. With
+ * tx_scanhold set the TIDs are paused instead, and the unsent frames
+ * are taken off the hardware queues in order onto axq_held. They are
+ * linked back onto the hardware queues, ahead of anything new, when we
+ * return to the channel they were queued on.
+ */
+
+static void ath_tx_hold_tids(struct ath_softc *sc, enum hal_bool pause)
+{
+	struct ath_node *an;
+	int tidno;
+
+	if (!sc->sc_txaggr)
+		return;
+
+	spin_lock_bh(&sc->node_lock);
+	list_for_each_entry(an, &sc->node_list, list) {
+		if (pause) {
+			an->an_flags |= ATH_NODE_TXHOLD;
+		} else {
+			/* joined during the visit, never paused */
+			if (!(an->an_flags & ATH_NODE_TXHOLD))
+				continue;
+			an->an_flags &= ~ATH_NODE_TXHOLD;
+		}
+
+		for (tidno = 0; tidno < WME_NUM_TID; tidno++) {
+			if (pause)
+				ath_tx_pause_tid(sc, ATH_AN_2_TID(an, tidno));
+			else
+				ath_tx_resume_tid(sc, ATH_AN_2_TID(an, tidno));
+		}
+	}
+	spin_unlock_bh(&sc->node_lock);
+}
+
+/* Fail held frames that will not be sent */
+
+static int ath_tx_hold_drop(struct ath_softc *sc, struct ath_txq *txq,
+			    struct list_head *q)
+{
+	struct ath_buf *bf, *lastbf;
+	struct list_head bf_head;
+	int nunits = 0;
+
+	while (!list_empty(q)) {
+		bf = list_first_entry(q, struct ath_buf, list);
+		lastbf = bf->bf_lastbf;
+		lastbf->bf_desc->ds_txstat.ts_flags = HAL_TX_SW_ABORTED;
+
+		INIT_LIST_HEAD(&bf_head);
+		list_cut_position(&bf_head, q, &lastbf->list);
+
+		if (bf->bf_isampdu)
+			ath_tx_complete_aggr_rifs(sc, txq, bf, &bf_head, 0);
+		else
+			ath_tx_complete_buf(sc, bf, &bf_head, 0, 0);
+		nunits++;
+	}
+	return nunits;
+}
+
+/*
+ * Called instead of ath_draintxq() before a scan leaves the channel.
+ * Returns AH_FALSE if tx is not held, and the caller must drain.
+ */
+
+enum hal_bool ath_tx_hold(struct ath_softc *sc)
+{
+	struct ath_hal *ah = sc->sc_ah;
+	struct ath_txq *txq;
+	struct ath_buf *bf;
+	struct list_head bf_head;
+	int i, npend = 0, nunits = 0;
+
+	if (sc->sc_invalid)
+		return AH_FALSE;
+
+	if (sc->sc_txhold) {
+		/*
+		 * Moving on to the next scan channel. Only frames sent
+		 * from the last one are on the hardware queues.
+		 */
+		(void) ath9k_hw_stoptxdma(ah, sc->sc_bhalq);
+		ath_tx_stopdma_data(sc);
+		for (i = 0; i < HAL_NUM_TX_QUEUES; i++) {
+			if (ATH_TXQ_SETUP(sc, i))
+				ath_tx_drainhwq(sc, &sc->sc_txq[i], AH_FALSE);
+		}
+		return AH_TRUE;
+	}
+
+	if (!sc->sc_config.tx_scanhold || !sc->sc_scanning)
+		return AH_FALSE;
+
+	/* nothing new may reach the hardware from here on */
+	ath_tx_hold_tids(sc, AH_TRUE);
+
+	(void) ath9k_hw_stoptxdma(ah, sc->sc_bhalq);
+	for (i = 0; i < HAL_NUM_TX_QUEUES; i++) {
+		if (ATH_TXQ_SETUP(sc, i)) {
+			ath_tx_stopdma(sc, &sc->sc_txq[i]);
+			npend += ath9k_hw_numtxpending(ah,
+						       sc->sc_txq[i].axq_qnum);
+		}
+	}
+	if (npend) {
+		/* the hardware still owns descriptors, drain as before */
+		DPRINTF(sc, ATH_DEBUG_XMIT,
+			"%s: unable to stop TxDMA, not holding\n", __func__);
+		ath_tx_hold_tids(sc, AH_FALSE);
+		return AH_FALSE;
+	}
+
+	for (i = 0; i < HAL_NUM_TX_QUEUES; i++) {
+		if (!ATH_TXQ_SETUP(sc, i))
+			continue;
+		txq = &sc->sc_txq[i];
+
+		/* complete what did go out before the queue stopped */
+		ath_tx_processq(sc, txq);
+
+		spin_lock_bh(&txq->axq_lock);
+		while (!list_empty(&txq->axq_q)) {
+			bf = list_first_entry(&txq->axq_q,
+					      struct ath_buf, list);
+
+			/* the hardware no longer links through it */
+			if (bf->bf_status & ATH_BUFSTATUS_STALE) {
+				list_del(&bf->list);
+				ath_txbuf_put(sc, bf);
+				continue;
+			}
+
+			INIT_LIST_HEAD(&bf_head);
+			list_cut_position(&bf_head, &txq->axq_q,
+					  &bf->bf_lastbf->list);
+			list_splice_tail(&bf_head, &txq->axq_held);
+			txq->axq_depth--;
+			if (bf->bf_isaggr)
+				txq->axq_aggr_depth--;
+			nunits++;
+		}
+		txq->axq_link = NULL;
+		txq->axq_linkbuf = NULL;
+		txq->axq_txdpbuf = NULL;
+		txq->axq_kickframes = 0;
+		txq->axq_lastdsWithCTS = NULL;
+		txq->axq_gatingds = NULL;
+		spin_unlock_bh(&txq->axq_lock);
+	}
+
+	sc->sc_txhold = 1;
+	sc->sc_txholdchan = sc->sc_curchan;
+	ath9k_debug_txhold(sc, nunits);
+
+	DPRINTF(sc, ATH_DEBUG_XMIT, "%s: holding %d tx units for %u MHz\n",
+		__func__, nunits, sc->sc_txholdchan.channel);
+	return AH_TRUE;
+}
+
+/*
+ * Called once the hardware is on hchan. Back on the channel the held
+ * frames were queued on they are sent again; if the scan is over and
+ * we are elsewhere they are failed. A NULL hchan fails them outright.
+ */
+
+void ath_tx_unhold(struct ath_softc *sc, struct hal_channel *hchan)
+{
+	struct ath_txq *txq;
+	struct ath_buf *bf;
+	struct list_head bf_head, bf_q;
+	enum hal_bool requeue = AH_FALSE;
+	int i, nunits;
+
+	if (!sc->sc_txhold)
+		return;
+
+	if (hchan != NULL &&
+	    hchan->channel == sc->sc_txholdchan.channel) {
+		/* scan channels use their own flags, wait for the real one */
+		if (hchan->channelFlags == sc->sc_txholdchan.channelFlags ||
+		    !sc->sc_scanning)
+			requeue = AH_TRUE;
+	}
+	if (!requeue && hchan != NULL && sc->sc_scanning)
+		return;
+
+	for (i = 0; i < HAL_NUM_TX_QUEUES; i++) {
+		if (!ATH_TXQ_SETUP(sc, i))
+			continue;
+		txq = &sc->sc_txq[i];
+		nunits = 0;
+
+		spin_lock_bh(&txq->axq_lock);
+		if (!requeue) {
+			INIT_LIST_HEAD(&bf_q);
+			list_splice_init(&txq->axq_held, &bf_q);
+			spin_unlock_bh(&txq->axq_lock);
+
+			nunits = ath_tx_hold_drop(sc, txq, &bf_q);
+			ath9k_debug_txunhold(sc, nunits, AH_FALSE);
+			continue;
+		}
+
+		ath_txq_batch_begin(txq);
+		while (!list_empty(&txq->axq_held)) {
+			bf = list_first_entry(&txq->axq_held,
+					      struct ath_buf, list);
+			INIT_LIST_HEAD(&bf_head);
+			list_cut_position(&bf_head, &txq->axq_held,
+					  &bf->bf_lastbf->list);
+			if (bf->bf_isaggr)
+				txq->axq_aggr_depth++;
+			ath_tx_txqaddbuf(sc, txq, &bf_head);
+			nunits++;
+		}
+		ath_txq_batch_end(sc, txq);
+		spin_unlock_bh(&txq->axq_lock);
+
+		ath9k_debug_txunhold(sc, nunits, AH_TRUE);
+	}
+
+	sc->sc_txhold = 0;
+
+	/* held frames go first, then whatever waited on the tids */
+	ath_tx_hold_tids(sc, AH_FALSE);
+}
+
 u_int32_t ath_txq_depth(struct ath_softc *sc, int qnum)
 {
 	return sc->sc_txq[qnum].axq_depth;
@@ -2679,6 +3601,10 @@ void ath_tx_aggr_teardown(struct ath_softc *sc,
 
 /*
  * Tx scheduling logic
+ *
+ * Node/ac pairs are served in turn, one tid each, until the hardware
+ * queue reaches its low water mark or every pair queued on entry has
+ * had a turn. All the aggregates built in one call share a doorbell.
  * NB: must be called with txq lock held
  */
 
@@ -2686,60 +3612,88 @@ void ath_txq_schedule(struct ath_softc *sc, struct ath_txq *txq)
 {
 	struct ath_atx_ac *ac;
 	struct ath_atx_tid *tid;
+	int nacs = 0;
 
 	/* nothing to schedule */
 	if (list_empty(&txq->axq_acq))
 		return;
-	/*
-	 * get the first node/ac pair on the queue
-	 */
-	ac = list_first_entry(&txq->axq_acq, struct ath_atx_ac, list);
-	list_del(&ac->list);
-	ac->sched = AH_FALSE;
 
-	/*
-	 * process a single tid per destination
-	 */
-	do {
-		/* nothing to schedule */
-		if (list_empty(&ac->tid_q))
-			return;
+	list_for_each_entry(ac, &txq->axq_acq, list)
+		nacs++;
 
-		tid = list_first_entry(&ac->tid_q, struct ath_atx_tid, list);
-		list_del(&tid->list);
-		tid->sched = AH_FALSE;
+	ath_txq_batch_begin(txq);
 
-		if (tid->paused)    /* check next tid to keep h/w busy */
-			continue;
+	do {
+		/*
+		 * get the first node/ac pair on the queue
+		 */
+		ac = list_first_entry(&txq->axq_acq, struct ath_atx_ac, list);
 
-		if (!(tid->an->an_smmode == ATH_SM_PWRSAV_DYNAMIC) ||
-		    ((txq->axq_depth % 2) == 0)) {
-			ath_tx_sched_aggr(sc, txq, tid);
+		/*
+		 * in airtime fairness mode, run deficit round robin: a
+		 * pair that has spent its air time is given a fresh
+		 * quantum and moved to the back, so slow destinations
+		 * get fewer turns
+		 */
+		while (sc->sc_config.airtime_fair &&
+		       ac->airtime_deficit <= 0) {
+			ac->airtime_deficit += ATH_AIRTIME_QUANTUM;
+			list_move_tail(&ac->list, &txq->axq_acq);
+			ac = list_first_entry(&txq->axq_acq,
+					      struct ath_atx_ac, list);
 		}
 
+		list_del(&ac->list);
+		ac->sched = AH_FALSE;
+
 		/*
-		 * add tid to round-robin queue if more frames
-		 * are pending for the tid
+		 * process a single tid per destination
 		 */
-		if (!list_empty(&tid->buf_q))
-			ath_tx_queue_tid(txq, tid);
+		do {
+			/* nothing to schedule */
+			if (list_empty(&ac->tid_q))
+				break;
 
-		/* only schedule one TID at a time */
-		break;
-	} while (!list_empty(&ac->tid_q));
+			tid = list_first_entry(&ac->tid_q,
+					       struct ath_atx_tid, list);
+			list_del(&tid->list);
+			tid->sched = AH_FALSE;
+
+			if (tid->paused) /* check next tid to keep h/w busy */
+				continue;
+
+			if (!(tid->an->an_smmode == ATH_SM_PWRSAV_DYNAMIC) ||
+			    ((txq->axq_depth % 2) == 0)) {
+				ath_tx_sched_aggr(sc, txq, tid);
+			}
+
+			/*
+			 * add tid to round-robin queue if more frames
+			 * are pending for the tid
+			 */
+			if (!list_empty(&tid->buf_q))
+				ath_tx_queue_tid(txq, tid);
+
+			/* only schedule one TID at a time */
+			break;
+		} while (!list_empty(&ac->tid_q));
 
-	/*
-	 * schedule AC if more TIDs need processing
-	 */
-	if (!list_empty(&ac->tid_q)) {
 		/*
-		 * add dest ac to txq if not already added
+		 * schedule AC if more TIDs need processing
 		 */
-		if (ac->sched == AH_FALSE) {
-			ac->sched = AH_TRUE;
-			list_add_tail(&ac->list, &txq->axq_acq);
+		if (!list_empty(&ac->tid_q)) {
+			/*
+			 * add dest ac to txq if not already added
+			 */
+			if (ac->sched == AH_FALSE) {
+				ac->sched = AH_TRUE;
+				list_add_tail(&ac->list, &txq->axq_acq);
+			}
 		}
-	}
+	} while (--nacs > 0 && !list_empty(&txq->axq_acq) &&
+		 txq->axq_depth < ATH_AGGR_MIN_QDEPTH);
+
+	ath_txq_batch_end(sc, txq);
 }
 
 /* Initialize per-node transmit state */
@@ -2752,6 +3706,7 @@ void ath_tx_node_init(struct ath_softc *sc, struct ath_node *an)
 		int tidno, acno;
 
 		sc->sc_ht_info.maxampdu = ATH_AMPDU_LIMIT_DEFAULT;
+		sc->sc_ht_info.maxamsdu = ATH_AMSDU_LIMIT_DEFAULT;
 
 		/*
 		 * Init per tid tx state
@@ -2767,6 +3722,8 @@ void ath_tx_node_init(struct ath_softc *sc, struct ath_node *an)
 			tid->sched     = AH_FALSE;
 			tid->paused = AH_FALSE;
 			tid->cleanup_inprogress = AH_FALSE;
+			tid->aggr_max = ATH_AMPDU_SUBFRAME_DEFAULT;
+			tid->aggr_per = 0;
 			INIT_LIST_HEAD(&tid->buf_q);
 
 			acno = TID_TO_WME_AC(tidno);
@@ -2784,6 +3741,8 @@ void ath_tx_node_init(struct ath_softc *sc, struct ath_node *an)
 		for (acno = 0, ac = &an->an_aggr.tx.ac[acno];
 				acno < WME_NUM_AC; acno++, ac++) {
 			ac->sched    = AH_FALSE;
+			ac->airtime_deficit = ATH_AIRTIME_QUANTUM;
+			ac->airtime_used = 0;
 			INIT_LIST_HEAD(&ac->tid_q);
 
 			switch (acno) {